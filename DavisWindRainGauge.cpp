@@ -1,180 +1,191 @@
 #include <stdio.h>
 #include <hardware/adc.h>
-#include <hardware/rtc.h>
 #include <pico/stdlib.h>
 #include <pico/critical_section.h>
 #include <pico/multicore.h>
-#include <PicoLed.hpp>
+#include <hardware/watchdog.h>
+#include "board.hpp"
+#include "calendar.h"
+#include "energy.h"
+#include "leds.h"
 #include "low_power.h"
+#include "persist.h"
 #include "i2c.h"
 #include "wind.h"
+#include "wind_rose.h"
 #include "rain.h"
-
-#define I2C_SLAVE_ADDRESS 0x17
-#define I2C_SLAVE_SDA_PIN 0
-#define I2C_SLAVE_SCL_PIN 1
-
-#define LED_PIN 16
-#define LED_LENGTH 1
+#include "rain_histogram.h"
+#include "sample_fifo.h"
+#include "stream.h"
 
 #define HB_BLINK_INTVL_SEC 5
 
-#define BUCKET_PIN 14
-#define BUCKET_IRQ_MASK GPIO_IRQ_EDGE_FALL
-// #define BUCKET_PIN_PULL_UP
-
-#define WIND_PIN 15
-#define WIND_DIRECTION_PIN 29      // this is an analog input
-#define WIND_DIRECTION_ADC_INPUT 3 // this is an analog input
-#define WIND_IRQ_MASK GPIO_IRQ_EDGE_FALL
-// #define WIND_PIN_PULL_UP
+/*
+ * main loop is woken up at least every WIND_DIR_SAMPLER_SECS by the
+ * wind direction timer, so this leaves plenty of margin.
+ */
+#define WATCHDOG_TIMEOUT_MS 5000
 
 /* timers */
 struct repeating_timer hb_blink_timer;
 
 /* */
 static bool hb_blink = false;
-
-static void shutdown_leds(PicoLed::PicoLedController ledStrip)
-{
-  ledStrip.setBrightness(0);
-  ledStrip.fill(PicoLed::RGB(0, 0, 0));
-  ledStrip.show();
-  sleep_ms(5);
-}
-
-static void blink_led(PicoLed::PicoLedController ledStrip, PicoLed::Color color, uint32_t ms)
-{
-  ledStrip.setBrightness(20);
-  ledStrip.fill(color);
-  ledStrip.show();
-  sleep_ms(ms);
-  shutdown_leds(ledStrip);
-}
-
+/* bumped by core 1 every time it wakes up, proves it's not stuck */
+static volatile uint32_t core1_heartbeat = 0;
+
+/*
+ * Only the bucket and wind pins have irqs enabled, so anything that is
+ * not the bucket is the wind.
+ */
+template <typename Board>
 void gpio_callback(uint gpio, uint32_t events)
 {
-  if ((gpio == BUCKET_PIN) && (events & BUCKET_IRQ_MASK))
+  uint32_t now = energy_isr_begin();
+
+  if (gpio == Board::bucket_pin)
   {
-    rain_gauge_tick();
+    if (board_irq_matches<Board::bucket_irq_mask>(events))
+    {
+      stream_edge(STREAM_EDGE_RAIN, now);
+      rain_gauge_tick();
+    }
   }
-  else if ((gpio == WIND_PIN) && (events & WIND_IRQ_MASK))
+  else if (board_irq_matches<Board::wind_irq_mask>(events))
   {
+    stream_edge(STREAM_EDGE_WIND, now);
     wind_speed_tick();
   }
+
+  energy_isr_end(ENERGY_SRC_GPIO, now);
 }
 
+template <typename Board>
 static void init_gpios(void)
 {
-  gpio_init(BUCKET_PIN);
-  gpio_init(WIND_PIN);
+  gpio_init(Board::bucket_pin);
+  gpio_init(Board::wind_pin);
 
-#ifdef BUCKET_PIN_PULL_UP
-  gpio_pull_up(BUCKET_PIN);
-#endif
-#ifdef WIND_PIN_PULL_UP
-  gpio_pull_up(WIND_PIN);
-#endif
+  if constexpr (Board::bucket_pull_up)
+  {
+    gpio_pull_up(Board::bucket_pin);
+  }
+  if constexpr (Board::wind_pull_up)
+  {
+    gpio_pull_up(Board::wind_pin);
+  }
 
-  gpio_set_irq_enabled(BUCKET_PIN, BUCKET_IRQ_MASK, true);
-  gpio_set_irq_enabled(WIND_PIN, WIND_IRQ_MASK, true);
+  gpio_set_irq_enabled(Board::bucket_pin, Board::bucket_irq_mask, true);
+  gpio_set_irq_enabled(Board::wind_pin, Board::wind_irq_mask, true);
 
-  gpio_set_irq_callback(&gpio_callback);
+  gpio_set_irq_callback(&gpio_callback<Board>);
   irq_set_priority(IO_IRQ_BANK0, 0xff);
   irq_set_enabled(IO_IRQ_BANK0, true);
 }
 
-static void signal_startup_with_leds(PicoLed::PicoLedController ledStrip)
-{
-
-  blink_led(ledStrip, PicoLed::RGB(255, 0, 0), 500);
-  blink_led(ledStrip, PicoLed::RGB(0, 255, 0), 500);
-  blink_led(ledStrip, PicoLed::RGB(0, 0, 255), 500);
-}
-
-static void rtc_alarm_callback(void)
+static void signal_startup_with_leds()
 {
-  rain_rtc_timer_cb();
-}
-
-static void schedule_rtc_every_1_minute()
-{
-  datetime_t alarm = {
-      .year = -1,
-      .month = -1,
-      .day = -1,
-      .dotw = -1, // 0 is Sunday, so 3 is Wednesday
-      .hour = -1,
-      .min = -1,
-      .sec = 0};
-
-  rtc_set_alarm(&alarm, &rtc_alarm_callback);
-}
-
-static void setup_rtc()
-{
-  // Start on Wednesday 13th January 2021 11:20:00
-  datetime_t t = {
-      .year = 2020,
-      .month = 01,
-      .day = 13,
-      .dotw = 3, // 0 is Sunday, so 3 is Wednesday
-      .hour = 11,
-      .min = 20,
-      .sec = 00};
-
-  // Start the RTC
-  rtc_init();
-  rtc_set_datetime(&t);
+  // queued, played in background while the rest of the init goes on
+  leds_blink(255, 0, 0, 500);
+  leds_blink(0, 255, 0, 500);
+  leds_blink(0, 0, 255, 500);
 }
 
 static void init_adc_inputs()
 {
   adc_init();
-  adc_gpio_init(WIND_DIRECTION_PIN);
+  adc_gpio_init(board_t::wind_direction_pin);
 }
 
 static bool hb_timer_callback(struct repeating_timer *t)
 {
+  uint32_t start = energy_isr_begin();
   hb_blink = true;
+  energy_isr_end(ENERGY_SRC_HEARTBEAT, start);
 
   return true;
 }
 
-static void schedule_blink_hb(PicoLed::PicoLedController ledStrip)
+static void schedule_blink_hb()
 {
   bool res = add_repeating_timer_ms(-(HB_BLINK_INTVL_SEC * 1000), hb_timer_callback, NULL, &hb_blink_timer);
 
   if (!res)
   {
-    blink_led(ledStrip, PicoLed::RGB(0, 0, 255), 25);
+    leds_blink(0, 0, 255, 25);
   }
 }
 
 void core1_entry()
 {
   //  init i2c slave interface
-  start_i2c_slave(I2C_SLAVE_ADDRESS, I2C_SLAVE_SDA_PIN, I2C_SLAVE_SCL_PIN);
+  start_i2c_slave(board_t::i2c_address, board_t::i2c_sda_pin, board_t::i2c_scl_pin);
+
+  // everything else happens in the i2c irq, just wait for core 0 to poke us
+  while (true)
+  {
+    core1_heartbeat++;
+    energy_wfe();
+  }
+}
+
+/*
+ * Called on every main loop wakeup: the watchdog is fed only if
+ * core 1 answered the previous poke, so a hang on either core reboots.
+ */
+static void feed_watchdog()
+{
+  static uint32_t prev_core1_heartbeat = 0;
+
+  if (core1_heartbeat != prev_core1_heartbeat)
+  {
+    prev_core1_heartbeat = core1_heartbeat;
+    watchdog_update();
+  }
+  __sev();
 }
 
 int main()
 {
-  int32_t prev_rain_pulses, prev_wind_pulses = 0;
+  int32_t prev_rain_pulses = 0, prev_wind_pulses = 0;
+  bool warm_boot;
 
   set_low_power();
 
+  // first, everybody else reports to it
+  energy_init();
+
   // Re init uart now that clk_peri has changed
   stdio_init_all();
 
+  // counters survived the reset? then skip the show and resume counting asap
+  warm_boot = persist_init();
+
+  // Start the Real time clock
+  calendar_init();
+
+  /* init rain stuff */
+  rain_init();
+
+  /* fed by the wind windows */
+  sample_fifo_init();
+
+  /* init wind stuff */
+  bool wind_ok = wind_init(board_t::wind_direction_adc_input);
+
+  persist_restore();
+
   // Start i2c over core 1
   // see: https://github.com/raspberrypi/pico-sdk/issues/1102
   multicore_launch_core1(core1_entry);
 
-  auto ledStrip = PicoLed::addLeds<PicoLed::WS2812B>(pio0, 0, LED_PIN, LED_LENGTH, PicoLed::FORMAT_GRB);
-  signal_startup_with_leds(ledStrip);
+#ifdef STREAM_ENABLED
+  /* raw data over uart, for calibration runs */
+  stream_init();
+#endif
 
   /* init gpios */
-  init_gpios();
+  init_gpios<board_t>();
 
   /* init adc */
   init_adc_inputs();
@@ -182,24 +193,31 @@ int main()
   /* enable onboard temp adc input*/
   adc_set_temp_sensor_enabled(true);
 
-  // Start the Real time clock
-  setup_rtc();
+  leds_init(board_t::led_pin, board_t::led_length);
+  if (!warm_boot)
+  {
+    signal_startup_with_leds();
+  }
 
-  /* init wind stuff */
-  if (!wind_init(WIND_DIRECTION_ADC_INPUT))
+  if (!wind_ok)
   {
-    blink_led(ledStrip, PicoLed::RGB(255, 0, 0), 25);
+    leds_blink(255, 0, 0, 25);
   }
 
-  schedule_rtc_every_1_minute();
+  calendar_on_boundary(CALENDAR_BOUNDARY_DAY, &rain_daily_reset);
+  calendar_on_boundary(CALENDAR_BOUNDARY_DAY, &rain_histogram_rollover);
+  calendar_on_boundary(CALENDAR_BOUNDARY_HOUR, &wind_rose_hour_reset);
+  calendar_on_boundary(CALENDAR_BOUNDARY_DAY, &wind_rose_day_reset);
 
-  schedule_blink_hb(ledStrip);
+  schedule_blink_hb();
+
+  watchdog_enable(WATCHDOG_TIMEOUT_MS, true);
 
   while (true)
   {
     if ((rain_get_pulses() > prev_rain_pulses) || (wind_pulses > prev_wind_pulses))
     {
-      blink_led(ledStrip, PicoLed::RGB(0, 255, 255), 25);
+      leds_blink(0, 255, 255, 25);
     }
     prev_rain_pulses = rain_get_pulses();
     prev_wind_pulses = wind_pulses;
@@ -207,9 +225,12 @@ int main()
     if (hb_blink)
     {
       hb_blink = false;
-      blink_led(ledStrip, PicoLed::RGB(255, 255, 0), 25);
+      leds_blink(255, 255, 0, 25);
     }
 
-    __wfi();
+    persist_save();
+    feed_watchdog();
+
+    energy_wfi();
   }
-}
\ No newline at end of file
+}
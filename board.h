@@ -0,0 +1,14 @@
+#ifndef _BOARD_H_
+#define _BOARD_H_
+
+/*
+ * Board profile: pins and per mast settings, one header per variant in
+ * boards/. The CMake target picks it, see davis_add_board() there.
+ */
+#ifndef BOARD_PROFILE_HEADER
+#define BOARD_PROFILE_HEADER "boards/rp2040_zero.h"
+#endif
+
+#include BOARD_PROFILE_HEADER
+
+#endif
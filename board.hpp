@@ -0,0 +1,102 @@
+#ifndef _BOARD_HPP_
+#define _BOARD_HPP_
+
+#include <pico/stdlib.h>
+#include "board.h"
+
+/*
+ * Typed view of the board profile: a wrong pin setup fails the build
+ * instead of a mast, and the irq dispatch is specialised for it.
+ */
+struct board_t
+{
+  static constexpr const char *name = BOARD_NAME;
+
+  static constexpr uint i2c_instance = BOARD_I2C_INSTANCE;
+  static constexpr uint8_t i2c_address = BOARD_I2C_ADDRESS;
+  static constexpr uint i2c_sda_pin = BOARD_I2C_SDA_PIN;
+  static constexpr uint i2c_scl_pin = BOARD_I2C_SCL_PIN;
+
+  static constexpr uint led_pin = BOARD_LED_PIN;
+  static constexpr uint led_length = BOARD_LED_LENGTH;
+
+  static constexpr uint bucket_pin = BOARD_BUCKET_PIN;
+  static constexpr uint32_t bucket_irq_mask = BOARD_BUCKET_IRQ_MASK;
+  static constexpr bool bucket_pull_up = BOARD_BUCKET_PULL_UP;
+
+  static constexpr uint wind_pin = BOARD_WIND_PIN;
+  static constexpr uint32_t wind_irq_mask = BOARD_WIND_IRQ_MASK;
+  static constexpr bool wind_pull_up = BOARD_WIND_PULL_UP;
+  static constexpr uint wind_direction_pin = BOARD_WIND_DIRECTION_PIN;
+  static constexpr uint8_t wind_direction_adc_input = BOARD_WIND_DIRECTION_ADC_INPUT;
+
+#ifdef STREAM_ENABLED
+  static constexpr uint pins[] = {i2c_sda_pin, i2c_scl_pin, led_pin, bucket_pin,
+                                  wind_pin, wind_direction_pin, BOARD_STREAM_TX_PIN};
+#else
+  static constexpr uint pins[] = {i2c_sda_pin, i2c_scl_pin, led_pin, bucket_pin,
+                                  wind_pin, wind_direction_pin};
+#endif
+};
+
+template <size_t N>
+constexpr bool board_pins_valid(const uint (&pins)[N])
+{
+  for (size_t i = 0; i < N; i++)
+  {
+    if (pins[i] >= NUM_BANK0_GPIOS)
+    {
+      return false;
+    }
+    for (size_t j = i + 1; j < N; j++)
+    {
+      if (pins[i] == pins[j])
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+constexpr bool board_irq_mask_valid(uint32_t mask)
+{
+  return mask != 0 && (mask & ~(GPIO_IRQ_LEVEL_LOW | GPIO_IRQ_LEVEL_HIGH | GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)) == 0;
+}
+
+static_assert(board_pins_valid(board_t::pins), "board pins must exist and be distinct");
+static_assert(board_t::wind_direction_adc_input < 4, "wind direction must be on ADC input 0 to 3");
+static_assert(board_t::wind_direction_pin == 26 + board_t::wind_direction_adc_input,
+              "wind direction pin is not the one of its ADC input");
+static_assert(board_t::i2c_instance < 2, "no such I2C instance");
+static_assert(board_t::i2c_sda_pin % 4 == 2 * board_t::i2c_instance &&
+                  board_t::i2c_scl_pin % 4 == 2 * board_t::i2c_instance + 1,
+              "I2C pins cannot be muxed to this I2C instance");
+static_assert(board_t::i2c_address >= 0x08 && board_t::i2c_address <= 0x77, "reserved I2C address");
+static_assert(board_irq_mask_valid(board_t::bucket_irq_mask) && board_irq_mask_valid(board_t::wind_irq_mask),
+              "bad gpio irq mask");
+static_assert(BOARD_BUCKET_DEBOUNCE_MS > 0 && BOARD_WIND_DEBOUNCE_MS > 0 && BOARD_WIND_SAMPLER_SECS > 0,
+              "debounce and sampling times must not be 0");
+#ifdef STREAM_ENABLED
+static_assert(BOARD_STREAM_TX_PIN % 16 == 4 || BOARD_STREAM_TX_PIN % 16 == 8, "not a uart1 tx pin");
+#endif
+
+/*
+ * Does an irq with this mask enabled need its events checked? The SDK only
+ * reports enabled events, so with a single one there is nothing to check.
+ */
+template <uint32_t mask>
+static inline bool board_irq_matches(uint32_t events)
+{
+  if constexpr ((mask & (mask - 1)) == 0)
+  {
+    return true;
+  }
+  else
+  {
+    return events & mask;
+  }
+}
+
+#endif
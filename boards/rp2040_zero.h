@@ -0,0 +1,33 @@
+#ifndef _BOARD_RP2040_ZERO_H_
+#define _BOARD_RP2040_ZERO_H_
+
+/* Waveshare RP2040-Zero, vane on the ADC3 pad, onboard WS2812 */
+#define BOARD_NAME "rp2040_zero"
+
+#define BOARD_I2C_INSTANCE 0
+#define BOARD_I2C_ADDRESS 0x17
+#define BOARD_I2C_SDA_PIN 0
+#define BOARD_I2C_SCL_PIN 1
+
+#define BOARD_LED_PIN 16
+#define BOARD_LED_LENGTH 1
+
+#define BOARD_BUCKET_PIN 14
+#define BOARD_BUCKET_IRQ_MASK GPIO_IRQ_EDGE_FALL
+#define BOARD_BUCKET_PULL_UP 0
+#define BOARD_BUCKET_DEBOUNCE_MS 100
+/* how many mm on rain for each spoon tip */
+#define BOARD_SPOON_SIZE 0.2
+
+#define BOARD_WIND_PIN 15
+#define BOARD_WIND_IRQ_MASK GPIO_IRQ_EDGE_FALL
+#define BOARD_WIND_PULL_UP 0
+#define BOARD_WIND_DEBOUNCE_MS 20
+#define BOARD_WIND_DIRECTION_PIN 29 // this is an analog input
+#define BOARD_WIND_DIRECTION_ADC_INPUT 3
+#define BOARD_WIND_SAMPLER_SECS 3
+
+/* uart1 tx, only used with DAVIS_STREAM */
+#define BOARD_STREAM_TX_PIN 4
+
+#endif
@@ -0,0 +1,401 @@
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include <hardware/rtc.h>
+#include "calendar.h"
+#include "energy.h"
+
+/*
+ * Time used until the master sets the real one. Defaults to the build time,
+ * so at least the year is right after a power loss.
+ */
+#ifndef CALENDAR_BUILD_EPOCH
+#define CALENDAR_BUILD_EPOCH 1609459200 // 2021-01-01 00:00:00 UTC
+#endif
+
+#define SECS_PER_HOUR (60 * 60)
+#define SECS_PER_DAY (24 * SECS_PER_HOUR)
+#define PPM 1000000
+
+/* Critical sections */
+static critical_section_t calendar_crit_sec;
+
+/*
+ * The RTC always holds UTC and is only written when the master sets the time.
+ * Between two settings it runs freely and the measured drift is applied
+ * in software when converting from RTC time to real time and back:
+ *   real = sync + (rtc - sync) * 1e6 / (1e6 + drift_ppm)
+ */
+static uint32_t sync_epoch = CALENDAR_BUILD_EPOCH;
+static bool synced = false;
+/* clock resumed from the persisted time after a warm reboot */
+static bool restored = false;
+static bool drift_measured = false;
+static int32_t drift_ppm = 0;
+static int16_t utc_offset_min = 0;
+
+static calendar_boundary_cb_t listeners[CALENDAR_BOUNDARY_COUNT][CALENDAR_MAX_LISTENERS];
+static uint8_t listeners_count[CALENDAR_BOUNDARY_COUNT];
+/* real time of the next occurrence of each boundary, 0 if none */
+static uint32_t boundary_next_epoch[CALENDAR_BOUNDARY_COUNT];
+/* real time of the last occurrence that fired, a clock set back must not fire it again */
+static uint32_t boundary_last_fired[CALENDAR_BOUNDARY_COUNT];
+
+static void calendar_arm_next_alarm();
+
+/*
+ * days <-> civil date conversion, see
+ * http://howardhinnant.github.io/date_algorithms.html
+ */
+static int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+  y -= m <= 2;
+  const int32_t era = (y >= 0 ? y : y - 399) / 400;
+  const uint32_t yoe = (uint32_t)(y - era * 400);
+  const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+static uint32_t datetime_to_epoch(const datetime_t *dt)
+{
+  int32_t days = days_from_civil(dt->year, dt->month, dt->day);
+
+  return (uint32_t)days * SECS_PER_DAY + dt->hour * SECS_PER_HOUR + dt->min * 60 + dt->sec;
+}
+
+static void epoch_to_datetime(uint32_t epoch, datetime_t *dt)
+{
+  int32_t z = epoch / SECS_PER_DAY;
+  uint32_t secs = epoch % SECS_PER_DAY;
+
+  dt->dotw = (z + 4) % 7; // 1970-01-01 was a Thursday
+  dt->hour = secs / SECS_PER_HOUR;
+  dt->min = (secs % SECS_PER_HOUR) / 60;
+  dt->sec = secs % 60;
+
+  z += 719468;
+  const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const uint32_t doe = (uint32_t)(z - era * 146097);
+  const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const uint32_t mp = (5 * doy + 2) / 153;
+
+  dt->day = doy - (153 * mp + 2) / 5 + 1;
+  dt->month = mp < 10 ? mp + 3 : mp - 9;
+  dt->year = (int32_t)yoe + era * 400 + (dt->month <= 2);
+}
+
+static uint32_t rtc_get_epoch()
+{
+  datetime_t now;
+
+  rtc_get_datetime(&now);
+
+  return datetime_to_epoch(&now);
+}
+
+/* RTC time to real time, rounded down */
+static uint32_t rtc_to_real(uint32_t rtc_epoch)
+{
+  int64_t elapsed = (int64_t)rtc_epoch - sync_epoch;
+
+  return sync_epoch + (elapsed * PPM) / (PPM + drift_ppm);
+}
+
+/* real time to RTC time, rounded up so the alarm never fires early */
+static uint32_t real_to_rtc(uint32_t real_epoch)
+{
+  int64_t elapsed = (int64_t)real_epoch - sync_epoch;
+
+  return sync_epoch + (elapsed * (PPM + drift_ppm) + PPM - 1) / PPM;
+}
+
+static uint32_t next_boundary(calendar_boundary_t boundary, uint32_t now)
+{
+  uint32_t period = (boundary == CALENDAR_BOUNDARY_DAY) ? SECS_PER_DAY : SECS_PER_HOUR;
+  int32_t offset = utc_offset_min * 60;
+  uint32_t local = now + offset;
+
+  return ((local / period) + 1) * period - offset;
+}
+
+/*
+ * Runs the listeners of the boundaries the clock went past, be it by
+ * ticking or by being set forward by the master.
+ */
+static void calendar_fire_due_boundaries()
+{
+  uint32_t now;
+  bool due[CALENDAR_BOUNDARY_COUNT];
+
+  critical_section_enter_blocking(&calendar_crit_sec);
+  now = rtc_to_real(rtc_get_epoch());
+  for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+  {
+    due[b] = boundary_next_epoch[b] != 0 && now >= boundary_next_epoch[b] &&
+             boundary_next_epoch[b] > boundary_last_fired[b];
+    if (due[b])
+    {
+      boundary_last_fired[b] = boundary_next_epoch[b];
+    }
+  }
+  critical_section_exit(&calendar_crit_sec);
+
+  // hour first, so that at midnight the hourly ones see the day still open
+  for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+  {
+    if (!due[b])
+    {
+      continue;
+    }
+    for (int i = 0; i < listeners_count[b]; i++)
+    {
+      listeners[b][i]();
+    }
+  }
+}
+
+static void rtc_alarm_callback(void)
+{
+  uint32_t start = energy_isr_begin();
+
+  calendar_fire_due_boundaries();
+  calendar_arm_next_alarm();
+  energy_isr_end(ENERGY_SRC_CALENDAR, start);
+}
+
+/*
+ * Arms the RTC for the earliest boundary somebody is listening to,
+ * instead of waking up every minute to check the time.
+ */
+static void calendar_arm_next_alarm()
+{
+  uint32_t now_rtc, now, alarm_epoch = 0, alarm_rtc;
+  datetime_t alarm;
+
+  critical_section_enter_blocking(&calendar_crit_sec);
+  now_rtc = rtc_get_epoch();
+  now = rtc_to_real(now_rtc);
+  for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+  {
+    if (listeners_count[b] == 0)
+    {
+      boundary_next_epoch[b] = 0;
+      continue;
+    }
+    boundary_next_epoch[b] = next_boundary(b, now);
+    if (alarm_epoch == 0 || boundary_next_epoch[b] < alarm_epoch)
+    {
+      alarm_epoch = boundary_next_epoch[b];
+    }
+  }
+
+  if (alarm_epoch == 0)
+  {
+    critical_section_exit(&calendar_crit_sec);
+    rtc_disable_alarm();
+    return;
+  }
+
+  alarm_rtc = real_to_rtc(alarm_epoch);
+  if (alarm_rtc <= now_rtc)
+  {
+    alarm_rtc = now_rtc + 1;
+  }
+  critical_section_exit(&calendar_crit_sec);
+
+  // all fields set, dotw included, so this is a one shot alarm
+  epoch_to_datetime(alarm_rtc, &alarm);
+  rtc_set_alarm(&alarm, &rtc_alarm_callback);
+}
+
+static int64_t calendar_rearm_callback(alarm_id_t id, void *user_data)
+{
+  uint32_t start = energy_isr_begin();
+  // a time set past a boundary must not skip it, e.g. midnight after a warm reboot,
+  // unless the clock was still on the cold boot guess, see calendar_set_datetime()
+  calendar_fire_due_boundaries();
+  calendar_arm_next_alarm();
+  energy_isr_end(ENERGY_SRC_CALENDAR, start);
+
+  return 0; // do not reschedule the alarm
+}
+
+/*
+ * The RTC irq must stay on core 0, while time and offset are set from the
+ * i2c handler on core 1: hand the re-arming over to a core 0 timer.
+ */
+static void calendar_request_rearm()
+{
+  add_alarm_in_ms(1, &calendar_rearm_callback, NULL, false);
+}
+
+static bool valid_datetime(const datetime_t *dt)
+{
+  return dt->year >= 1970 && dt->year <= 2105 && dt->month >= 1 && dt->month <= 12 &&
+         dt->day >= 1 && dt->day <= 31 && dt->hour >= 0 && dt->hour <= 23 &&
+         dt->min >= 0 && dt->min <= 59 && dt->sec >= 0 && dt->sec <= 59;
+}
+
+extern bool calendar_set_datetime(const datetime_t *dt)
+{
+  uint32_t now_rtc, real, elapsed;
+  int32_t measured_ppm;
+  datetime_t t;
+
+  if (!valid_datetime(dt))
+  {
+    return false;
+  }
+
+  real = datetime_to_epoch(dt);
+
+  critical_section_enter_blocking(&calendar_crit_sec);
+  now_rtc = rtc_get_epoch();
+  elapsed = real - sync_epoch;
+  if (synced && real > sync_epoch && elapsed >= CALENDAR_DRIFT_MIN_INTERVAL_SECS)
+  {
+    // RTC has been free running since last sync, compare against real time
+    measured_ppm = (((int64_t)now_rtc - sync_epoch) - elapsed) * PPM / elapsed;
+    if (measured_ppm > -CALENDAR_DRIFT_MAX_PPM && measured_ppm < CALENDAR_DRIFT_MAX_PPM)
+    {
+      // smooth out the 1 sec resolution of the measures
+      drift_ppm = drift_measured ? (3 * drift_ppm + measured_ppm) / 4 : measured_ppm;
+      drift_measured = true;
+    }
+  }
+
+  if (!synced && !restored)
+  {
+    // cold boot clock, the boundaries it was counting to are meaningless: re-arm without firing
+    for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+    {
+      boundary_next_epoch[b] = 0;
+    }
+  }
+
+  // do not trust the dotw coming from the master
+  epoch_to_datetime(real, &t);
+  rtc_set_datetime(&t);
+  sync_epoch = real;
+  synced = true;
+  critical_section_exit(&calendar_crit_sec);
+
+  calendar_request_rearm();
+
+  return true;
+}
+
+extern void calendar_get_datetime(datetime_t *dt)
+{
+  epoch_to_datetime(calendar_get_epoch(), dt);
+}
+
+extern uint32_t calendar_get_epoch()
+{
+  uint32_t now;
+
+  critical_section_enter_blocking(&calendar_crit_sec);
+  now = rtc_to_real(rtc_get_epoch());
+  critical_section_exit(&calendar_crit_sec);
+
+  return now;
+}
+
+extern void calendar_set_utc_offset(int16_t minutes)
+{
+  // valid offsets go from -12:00 to +14:00
+  if (minutes < -12 * 60 || minutes > 14 * 60)
+  {
+    return;
+  }
+
+  utc_offset_min = minutes;
+  calendar_request_rearm();
+}
+
+extern int16_t calendar_get_utc_offset()
+{
+  return utc_offset_min;
+}
+
+extern int32_t calendar_get_drift_ppm()
+{
+  return drift_ppm;
+}
+
+extern void calendar_save_state(calendar_state_t *state)
+{
+  critical_section_enter_blocking(&calendar_crit_sec);
+  state->epoch = rtc_to_real(rtc_get_epoch());
+  state->drift_ppm = drift_ppm;
+  state->drift_measured = drift_measured;
+  for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+  {
+    state->last_fired[b] = boundary_last_fired[b];
+  }
+  critical_section_exit(&calendar_crit_sec);
+
+  state->utc_offset_min = utc_offset_min;
+}
+
+extern void calendar_restore_state(const calendar_state_t *state)
+{
+  datetime_t t;
+
+  critical_section_enter_blocking(&calendar_crit_sec);
+  drift_ppm = state->drift_ppm;
+  drift_measured = state->drift_measured;
+  utc_offset_min = state->utc_offset_min;
+  for (int b = 0; b < CALENDAR_BOUNDARY_COUNT; b++)
+  {
+    boundary_last_fired[b] = state->last_fired[b];
+  }
+  /*
+   * The RTC restarts from the last saved time, behind by the time since the
+   * last persist_save() plus the reboot: about a second after a reset, up to
+   * WATCHDOG_TIMEOUT_MS (5 s) after a watchdog reboot if core 0 hung.
+   * Good enough to keep going, but not to measure drift against.
+   */
+  sync_epoch = state->epoch;
+  synced = false;
+  restored = true;
+  epoch_to_datetime(sync_epoch, &t);
+  rtc_set_datetime(&t);
+  critical_section_exit(&calendar_crit_sec);
+
+  busy_wait_us(64);
+  calendar_request_rearm();
+}
+
+extern bool calendar_on_boundary(calendar_boundary_t boundary, calendar_boundary_cb_t cb)
+{
+  if (boundary >= CALENDAR_BOUNDARY_COUNT || listeners_count[boundary] == CALENDAR_MAX_LISTENERS)
+  {
+    return false;
+  }
+
+  listeners[boundary][listeners_count[boundary]] = cb;
+  listeners_count[boundary]++;
+  calendar_arm_next_alarm();
+
+  return true;
+}
+
+extern bool calendar_init()
+{
+  datetime_t t;
+
+  critical_section_init(&calendar_crit_sec);
+
+  epoch_to_datetime(sync_epoch, &t);
+
+  // Start the RTC
+  rtc_init();
+  rtc_set_datetime(&t);
+  // new time is loaded after a few clk_rtc cycles, wait before reading it back
+  busy_wait_us(64);
+
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _CALENDAR_H_
+#define _CALENDAR_H_
+
+#include <pico/stdlib.h>
+#include <pico/util/datetime.h>
+
+/* how many callbacks can be attached to each boundary */
+#define CALENDAR_MAX_LISTENERS 4
+
+/*
+ * Drift is only measured when two time settings from the master are
+ * at least this far apart, since the RTC has a 1 second resolution.
+ * 12 hours gives ~23ppm resolution.
+ */
+#define CALENDAR_DRIFT_MIN_INTERVAL_SECS (12 * 60 * 60)
+/* anything larger than this is a bogus time setting, not drift */
+#define CALENDAR_DRIFT_MAX_PPM 1000
+
+typedef enum
+{
+  CALENDAR_BOUNDARY_HOUR,
+  CALENDAR_BOUNDARY_DAY,
+  CALENDAR_BOUNDARY_COUNT
+} calendar_boundary_t;
+
+typedef void (*calendar_boundary_cb_t)(void);
+
+/* what is needed to keep the time across a warm reboot */
+typedef struct
+{
+  uint32_t epoch;
+  int32_t drift_ppm;
+  int16_t utc_offset_min;
+  bool drift_measured;
+  uint32_t last_fired[CALENDAR_BOUNDARY_COUNT];
+} calendar_state_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool calendar_init();
+  extern bool calendar_on_boundary(calendar_boundary_t boundary, calendar_boundary_cb_t cb);
+  extern bool calendar_set_datetime(const datetime_t *dt);
+  extern void calendar_get_datetime(datetime_t *dt);
+  extern uint32_t calendar_get_epoch();
+  extern void calendar_set_utc_offset(int16_t minutes);
+  extern int16_t calendar_get_utc_offset();
+  extern int32_t calendar_get_drift_ppm();
+  extern void calendar_save_state(calendar_state_t *state);
+  extern void calendar_restore_state(const calendar_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
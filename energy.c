@@ -0,0 +1,222 @@
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include <hardware/sync.h>
+#include <hardware/structs/scb.h>
+#include "energy.h"
+
+/* rough defaults for a rp2040 zero at 12MHz, calibrate them per board */
+#define ENERGY_DEFAULT_SLEEP_UA 5000
+#define ENERGY_DEFAULT_CORE_ACTIVE_UA 1500
+#define ENERGY_DEFAULT_LED_UA 2000
+#define ENERGY_DEFAULT_ADC_NC 1
+#define ENERGY_DEFAULT_I2C_BYTE_NC 1
+
+typedef struct
+{
+  uint32_t calls;
+  uint64_t usec;
+} energy_source_stats_t;
+
+/* Critical sections */
+static critical_section_t energy_crit_sec;
+
+static uint64_t start_usec = 0;
+static uint64_t sleep_usec[NUM_CORES];
+static energy_source_stats_t sources[ENERGY_SRC_COUNT];
+static uint64_t led_on_usec = 0;
+static uint64_t led_on_since_usec = 0;
+static uint32_t adc_conversions = 0;
+static uint32_t i2c_bytes = 0;
+
+static energy_coeffs_t coeffs = {
+    .sleep_ua = ENERGY_DEFAULT_SLEEP_UA,
+    .core_active_ua = ENERGY_DEFAULT_CORE_ACTIVE_UA,
+    .led_ua = ENERGY_DEFAULT_LED_UA,
+    .adc_nc = ENERGY_DEFAULT_ADC_NC,
+    .i2c_byte_nc = ENERGY_DEFAULT_I2C_BYTE_NC};
+
+static void put_uint32(uint8_t **p, uint32_t val)
+{
+  memcpy(*p, &val, sizeof(val));
+  *p += sizeof(val);
+}
+
+static void put_uint64(uint8_t **p, uint64_t val)
+{
+  memcpy(*p, &val, sizeof(val));
+  *p += sizeof(val);
+}
+
+static void energy_account_sleep(uint64_t from, uint64_t to)
+{
+  critical_section_enter_blocking(&energy_crit_sec);
+  sleep_usec[get_core_num()] += to - from;
+  critical_section_exit(&energy_crit_sec);
+}
+
+/*
+ * Interrupts are masked while sleeping so that the wakeup timestamp is taken
+ * before the irq handler runs, its time then goes to the active side.
+ * A pending irq still wakes up wfi even if masked.
+ */
+extern void energy_wfi()
+{
+  uint32_t save = save_and_disable_interrupts();
+  uint64_t from = time_us_64();
+  __wfi();
+  uint64_t to = time_us_64();
+  restore_interrupts(save);
+
+  energy_account_sleep(from, to);
+}
+
+extern void energy_wfe()
+{
+  uint32_t save = save_and_disable_interrupts();
+  // with irqs masked wfe only wakes up on events, make pending irqs one
+  scb_hw->scr |= M0PLUS_SCR_SEVONPEND_BITS;
+  uint64_t from = time_us_64();
+  __wfe();
+  uint64_t to = time_us_64();
+  restore_interrupts(save);
+
+  energy_account_sleep(from, to);
+}
+
+extern uint32_t energy_isr_begin()
+{
+  return time_us_32();
+}
+
+extern void energy_isr_end(energy_source_t source, uint32_t start_usec)
+{
+  uint32_t elapsed = time_us_32() - start_usec;
+
+  critical_section_enter_blocking(&energy_crit_sec);
+  sources[source].calls++;
+  sources[source].usec += elapsed;
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_led(bool on)
+{
+  uint64_t now = time_us_64();
+
+  critical_section_enter_blocking(&energy_crit_sec);
+  if (on && led_on_since_usec == 0)
+  {
+    led_on_since_usec = now;
+  }
+  else if (!on && led_on_since_usec != 0)
+  {
+    led_on_usec += now - led_on_since_usec;
+    led_on_since_usec = 0;
+  }
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_count_adc()
+{
+  critical_section_enter_blocking(&energy_crit_sec);
+  adc_conversions++;
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_count_i2c_byte()
+{
+  critical_section_enter_blocking(&energy_crit_sec);
+  i2c_bytes++;
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_set_coeffs(const uint8_t block[ENERGY_COEFFS_SIZE])
+{
+  energy_coeffs_t c;
+
+  memcpy(&c.sleep_ua, &block[0], sizeof(uint32_t));
+  memcpy(&c.core_active_ua, &block[4], sizeof(uint32_t));
+  memcpy(&c.led_ua, &block[8], sizeof(uint32_t));
+  memcpy(&c.adc_nc, &block[12], sizeof(uint32_t));
+  memcpy(&c.i2c_byte_nc, &block[16], sizeof(uint32_t));
+
+  critical_section_enter_blocking(&energy_crit_sec);
+  coeffs = c;
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_read_coeffs(uint8_t block[ENERGY_COEFFS_SIZE])
+{
+  uint8_t *p = block;
+
+  critical_section_enter_blocking(&energy_crit_sec);
+  put_uint32(&p, coeffs.sleep_ua);
+  put_uint32(&p, coeffs.core_active_ua);
+  put_uint32(&p, coeffs.led_ua);
+  put_uint32(&p, coeffs.adc_nc);
+  put_uint32(&p, coeffs.i2c_byte_nc);
+  critical_section_exit(&energy_crit_sec);
+}
+
+extern void energy_read_diag(uint8_t block[ENERGY_DIAG_SIZE])
+{
+  uint8_t *p = block;
+  uint64_t now, uptime, sleep[NUM_CORES], active[NUM_CORES], led, charge_nc, avg_ua;
+  uint32_t adc, i2c;
+  energy_source_stats_t src_stats[ENERGY_SRC_COUNT];
+  energy_coeffs_t c;
+
+  // snapshot first, the maths is done out of the critical section
+  critical_section_enter_blocking(&energy_crit_sec);
+  // inside, the led may have been turned on by the other core just before
+  now = time_us_64();
+  memcpy(sleep, sleep_usec, sizeof(sleep));
+  memcpy(src_stats, sources, sizeof(src_stats));
+  led = led_on_usec + (led_on_since_usec != 0 ? now - led_on_since_usec : 0);
+  adc = adc_conversions;
+  i2c = i2c_bytes;
+  c = coeffs;
+  critical_section_exit(&energy_crit_sec);
+
+  uptime = now - start_usec;
+  for (int core = 0; core < NUM_CORES; core++)
+  {
+    active[core] = uptime > sleep[core] ? uptime - sleep[core] : 0;
+  }
+
+  /*
+   * average current = base + time weighted contributions + charges / time
+   * with charges in nC and time in usec, nC / usec * 1000 is uA.
+   */
+  charge_nc = (uint64_t)adc * c.adc_nc + (uint64_t)i2c * c.i2c_byte_nc;
+  avg_ua = c.sleep_ua;
+  if (uptime > 0)
+  {
+    avg_ua += ((active[0] + active[1]) * c.core_active_ua + led * c.led_ua) / uptime;
+    avg_ua += charge_nc * 1000 / uptime;
+  }
+
+  put_uint32(&p, uptime / 1000);
+  for (int core = 0; core < NUM_CORES; core++)
+  {
+    put_uint32(&p, sleep[core] / 1000);
+    put_uint32(&p, active[core] / 1000);
+  }
+  put_uint32(&p, led / 1000);
+  put_uint32(&p, adc);
+  put_uint32(&p, i2c);
+  put_uint32(&p, avg_ua);
+  for (int src = 0; src < ENERGY_SRC_COUNT; src++)
+  {
+    put_uint32(&p, src_stats[src].calls);
+    put_uint64(&p, src_stats[src].usec);
+  }
+}
+
+extern bool energy_init()
+{
+  critical_section_init(&energy_crit_sec);
+  start_usec = time_us_64();
+
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+
+#include <pico/stdlib.h>
+
+/*
+ * Where does the time (and so the battery) go: sleep vs active time on each
+ * core, time spent in each irq/timer callback, led on time, adc conversions
+ * and i2c traffic. Together with per board coefficients this gives an
+ * estimate of the average current draw.
+ */
+
+typedef enum
+{
+  ENERGY_SRC_GPIO,
+  ENERGY_SRC_WIND_TIMERS,
+  ENERGY_SRC_RAIN_ALARMS,
+  ENERGY_SRC_LEDS,
+  ENERGY_SRC_CALENDAR,
+  ENERGY_SRC_I2C,
+  ENERGY_SRC_STREAM,
+  ENERGY_SRC_HEARTBEAT,
+  ENERGY_SRC_COUNT
+} energy_source_t;
+
+/* per board calibration, measure them with a multimeter */
+typedef struct
+{
+  uint32_t sleep_ua;       // whole board, both cores sleeping, led off
+  uint32_t core_active_ua; // added by each core while running
+  uint32_t led_ua;         // added while the led is on
+  uint32_t adc_nc;         // charge of a single adc conversion
+  uint32_t i2c_byte_nc;    // charge of a single i2c byte
+} energy_coeffs_t;
+
+#define ENERGY_COEFFS_SIZE (5 * sizeof(uint32_t))
+
+/*
+ * I2C diagnostics block, little endian:
+ *   uptime ms, core 0 sleep ms, core 0 active ms, core 1 sleep ms, core 1 active ms,
+ *   led on ms, adc conversions, i2c bytes, estimated average current uA (all uint32)
+ * followed, for each energy_source_t, by calls (uint32) and total usec (uint64)
+ */
+#define ENERGY_DIAG_SIZE (9 * sizeof(uint32_t) + ENERGY_SRC_COUNT * (sizeof(uint32_t) + sizeof(uint64_t)))
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool energy_init();
+  extern void energy_wfi();
+  extern void energy_wfe();
+  extern uint32_t energy_isr_begin();
+  extern void energy_isr_end(energy_source_t source, uint32_t start_usec);
+  extern void energy_led(bool on);
+  extern void energy_count_adc();
+  extern void energy_count_i2c_byte();
+  extern void energy_set_coeffs(const uint8_t block[ENERGY_COEFFS_SIZE]);
+  extern void energy_read_coeffs(uint8_t block[ENERGY_COEFFS_SIZE]);
+  extern void energy_read_diag(uint8_t block[ENERGY_DIAG_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * davis_read: prints the samples published by davisd, as they arrive.
+ * Also an example of how to consume the shared memory ring.
+ *
+ *   davis_read [-s shm_name] [-n count] [-t timeout_ms]
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "davis_shm.h"
+
+int main(int argc, char **argv)
+{
+  const char *shm_name = DAVIS_SHM_NAME;
+  long count = -1;
+  long timeout_ms = -1;
+  const davis_shm_t *shm;
+  davis_sample_t sample;
+  struct timespec timeout;
+  uint64_t seq, head;
+  int opt, res;
+
+  while ((opt = getopt(argc, argv, "s:n:t:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      shm_name = optarg;
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 0);
+      break;
+    case 't':
+      timeout_ms = strtol(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s shm_name] [-n count] [-t timeout_ms]\n", argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  shm = davis_shm_open_reader(shm_name);
+  if (shm == NULL)
+  {
+    fprintf(stderr, "cannot open shared memory %s: %s\n", shm_name, strerror(errno));
+    return 1;
+  }
+
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+  // start from the latest sample
+  seq = davis_shm_head(shm);
+  printf("seq,timestamp_ns,device_time,wind_speed,wind_direction,rain_rate,rain_daily,flags\n");
+  while (count != 0)
+  {
+    head = davis_shm_wait(shm, seq, timeout_ms >= 0 ? &timeout : NULL);
+    if (head == seq)
+    {
+      if (timeout_ms < 0)
+      {
+        // woken early, nothing new yet
+        continue;
+      }
+      fprintf(stderr, "no new samples in %ld ms\n", timeout_ms);
+      return 2;
+    }
+
+    for (seq = seq + 1; seq <= head && count != 0; seq++)
+    {
+      res = davis_shm_read(shm, seq, &sample);
+      if (res == -ENODATA)
+      {
+        // too slow, the writer lapped us
+        fprintf(stderr, "lost sample %" PRIu64 "\n", seq);
+        continue;
+      }
+      printf("%" PRIu64 ",%" PRId64 ",%" PRId64 ",%.2f,%" PRId32 ",%.2f,%.2f,%" PRIu32 "\n",
+             sample.seq, sample.timestamp_ns, sample.device_time, sample.wind_speed,
+             sample.wind_direction, sample.rain_rate, sample.rain_daily, sample.flags);
+      if (count > 0)
+      {
+        count--;
+      }
+    }
+    seq = head;
+    fflush(stdout);
+  }
+
+  return 0;
+}
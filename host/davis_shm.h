@@ -0,0 +1,179 @@
+#ifndef _DAVIS_SHM_H_
+#define _DAVIS_SHM_H_
+
+/*
+ * Shared memory ring published by davisd, the only process polling the
+ * gauge over I2C. Any number of local readers map it read only and wait
+ * for new samples on a futex, no syscall is needed to read a sample.
+ *
+ * Each slot is protected by a seqlock: the writer makes the slot sequence
+ * odd while writing and even again when done, readers retry if it changed
+ * under them. Readers that fall more than DAVIS_SHM_SLOTS behind are told
+ * so and skip ahead.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define DAVIS_SHM_NAME "/davis_wind_rain"
+#define DAVIS_SHM_MAGIC 0x44575253 // "DWRS"
+#define DAVIS_SHM_VERSION 1
+/* must be a power of 2 */
+#define DAVIS_SHM_SLOTS 256
+
+/* sample flags */
+#define DAVIS_SAMPLE_I2C_ERROR 0x1 // at least one read failed, its value is stale
+
+typedef struct
+{
+  uint64_t seq;         // sample number, starting from 1
+  int64_t timestamp_ns; // CLOCK_REALTIME when polled
+  int64_t device_time;  // gauge RTC, seconds since epoch
+  float wind_speed;     // km/h
+  int32_t wind_direction;
+  float rain_rate; // mm/h
+  float rain_daily;
+  uint32_t flags;
+  uint32_t reserved;
+} davis_sample_t;
+
+typedef struct
+{
+  _Atomic uint32_t lock;
+  uint32_t pad;
+  davis_sample_t sample;
+} davis_slot_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t sample_size;
+  /* seq of the latest published sample, 0 if none */
+  _Atomic uint64_t head;
+  /* bumped on every publish, readers FUTEX_WAIT on it */
+  _Atomic uint32_t futex;
+  uint32_t pad;
+  davis_slot_t slot[DAVIS_SHM_SLOTS];
+} davis_shm_t;
+
+static inline long davis_futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+  // shared mapping: no FUTEX_PRIVATE_FLAG
+  return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, NULL, 0);
+}
+
+/* writer side, used by davisd only */
+static inline void davis_shm_publish(davis_shm_t *shm, davis_sample_t *sample)
+{
+  uint64_t seq = atomic_load_explicit(&shm->head, memory_order_relaxed) + 1;
+  davis_slot_t *slot = &shm->slot[seq & (DAVIS_SHM_SLOTS - 1)];
+  uint32_t lock = atomic_load_explicit(&slot->lock, memory_order_relaxed);
+
+  sample->seq = seq;
+
+  atomic_store_explicit(&slot->lock, lock + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot->sample = *sample;
+  atomic_store_explicit(&slot->lock, lock + 2, memory_order_release);
+
+  atomic_store_explicit(&shm->head, seq, memory_order_release);
+  atomic_fetch_add_explicit(&shm->futex, 1, memory_order_release);
+  davis_futex(&shm->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/* maps the ring read only, returns NULL on error with errno set */
+static inline const davis_shm_t *davis_shm_open_reader(const char *name)
+{
+  const davis_shm_t *shm;
+  int fd = shm_open(name, O_RDONLY, 0);
+
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  shm = mmap(NULL, sizeof(davis_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  if (shm->magic != DAVIS_SHM_MAGIC || shm->version != DAVIS_SHM_VERSION ||
+      shm->slots != DAVIS_SHM_SLOTS || shm->sample_size != sizeof(davis_sample_t))
+  {
+    munmap((void *)shm, sizeof(davis_shm_t));
+    errno = EPROTO;
+    return NULL;
+  }
+
+  return shm;
+}
+
+static inline uint64_t davis_shm_head(const davis_shm_t *shm)
+{
+  return atomic_load_explicit((_Atomic uint64_t *)&shm->head, memory_order_acquire);
+}
+
+/*
+ * Reads sample number seq.
+ * Returns 0 on success, -EAGAIN if not published yet,
+ * -ENODATA if it has already been overwritten.
+ */
+static inline int davis_shm_read(const davis_shm_t *shm, uint64_t seq, davis_sample_t *sample)
+{
+  const davis_slot_t *slot = &shm->slot[seq & (DAVIS_SHM_SLOTS - 1)];
+  uint32_t before, after;
+
+  if (seq == 0 || seq > davis_shm_head(shm))
+  {
+    return -EAGAIN;
+  }
+
+  do
+  {
+    before = atomic_load_explicit((_Atomic uint32_t *)&slot->lock, memory_order_acquire);
+    if (before & 1)
+    {
+      // being written right now
+      continue;
+    }
+    memcpy(sample, (const void *)&slot->sample, sizeof(*sample));
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit((_Atomic uint32_t *)&slot->lock, memory_order_relaxed);
+  } while ((before & 1) || before != after);
+
+  return sample->seq == seq ? 0 : -ENODATA;
+}
+
+/*
+ * Waits until something newer than seq is published, or timeout (NULL for
+ * none) expires. Returns the new head, which may still be seq on timeout.
+ */
+static inline uint64_t davis_shm_wait(const davis_shm_t *shm, uint64_t seq, const struct timespec *timeout)
+{
+  _Atomic uint32_t *futex = (_Atomic uint32_t *)&shm->futex;
+  uint32_t val = atomic_load_explicit(futex, memory_order_acquire);
+  uint64_t head = davis_shm_head(shm);
+
+  if (head == seq)
+  {
+    davis_futex(futex, FUTEX_WAIT, val, timeout);
+    head = davis_shm_head(shm);
+  }
+
+  return head;
+}
+
+#endif
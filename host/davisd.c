@@ -0,0 +1,327 @@
+/*
+ * davisd: polls the wind/rain gauge over I2C and publishes the samples
+ * into a shared memory ring (see davis_shm.h), so that any number of local
+ * processes can read them without touching the bus.
+ *
+ *   davisd [-d /dev/i2c-1] [-a 0x17] [-i interval_ms] [-s shm_name] [-n count] [-m]
+ *
+ * -m uses an in-process mock gauge instead of the I2C bus, for testing
+ * without hardware.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "davis_shm.h"
+#include "i2c_commands.h"
+
+#define DEFAULT_I2C_DEVICE "/dev/i2c-1"
+#define DEFAULT_I2C_ADDRESS 0x17
+#define DEFAULT_INTERVAL_MS 1000
+
+typedef struct davis_device
+{
+  /* writes the command byte, then reads len bytes after a repeated start */
+  int (*transfer)(struct davis_device *dev, uint8_t command, uint8_t *buf, size_t len);
+  int fd;
+  uint16_t address;
+  /* mock state */
+  uint32_t mock_polls;
+  float mock_rain_daily;
+} davis_device_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  running = 0;
+}
+
+static int i2c_transfer(davis_device_t *dev, uint8_t command, uint8_t *buf, size_t len)
+{
+  struct i2c_msg msgs[2] = {
+      {.addr = dev->address, .flags = 0, .len = 1, .buf = &command},
+      {.addr = dev->address, .flags = I2C_M_RD, .len = len, .buf = buf}};
+  struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = 2};
+
+  return ioctl(dev->fd, I2C_RDWR, &data) < 0 ? -errno : 0;
+}
+
+/* answers like the firmware would, with values slowly changing */
+static int mock_transfer(davis_device_t *dev, uint8_t command, uint8_t *buf, size_t len)
+{
+  float f;
+  int32_t i;
+  time_t now = time(NULL);
+  struct tm tm;
+
+  switch (command)
+  {
+  case I2C_COMMAND_READ_WIND_SPEED:
+    dev->mock_polls++;
+    f = 10.0f + 5.0f * sinf(dev->mock_polls / 10.0f);
+    memcpy(buf, &f, sizeof(f));
+    break;
+  case I2C_COMMAND_READ_WIND_DIRECTION:
+    i = (dev->mock_polls * 7) % 360;
+    memcpy(buf, &i, sizeof(i));
+    break;
+  case I2C_COMMAND_READ_RAIN_RATE:
+    f = (dev->mock_polls % 20) < 10 ? 2.4f : 0.0f;
+    memcpy(buf, &f, sizeof(f));
+    break;
+  case I2C_COMMAND_READ_RAIN_DAILY:
+    if ((dev->mock_polls % 20) < 10)
+    {
+      dev->mock_rain_daily += 0.2f;
+    }
+    memcpy(buf, &dev->mock_rain_daily, sizeof(dev->mock_rain_daily));
+    break;
+  case I2C_COMMAND_READ_RTC:
+    gmtime_r(&now, &tm);
+    buf[0] = (tm.tm_year + 1900) >> 8;
+    buf[1] = (tm.tm_year + 1900) & 0xff;
+    buf[2] = tm.tm_mon + 1;
+    buf[3] = tm.tm_mday;
+    buf[4] = tm.tm_wday;
+    buf[5] = tm.tm_hour;
+    buf[6] = tm.tm_min;
+    buf[7] = tm.tm_sec;
+    break;
+  default:
+    memset(buf, 0xff, len);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static int read_value(davis_device_t *dev, uint8_t command, void *value, size_t len, davis_sample_t *sample)
+{
+  uint8_t buf[8];
+  int res = dev->transfer(dev, command, buf, len);
+
+  if (res < 0)
+  {
+    // keep the previous value, but flag it
+    sample->flags |= DAVIS_SAMPLE_I2C_ERROR;
+    return res;
+  }
+  memcpy(value, buf, len);
+
+  return 0;
+}
+
+static void poll_device(davis_device_t *dev, davis_sample_t *sample)
+{
+  uint8_t rtc[8];
+  struct timespec ts;
+  struct tm tm = {0};
+
+  sample->flags = 0;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  sample->timestamp_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+  read_value(dev, I2C_COMMAND_READ_WIND_SPEED, &sample->wind_speed, sizeof(float), sample);
+  read_value(dev, I2C_COMMAND_READ_WIND_DIRECTION, &sample->wind_direction, sizeof(int32_t), sample);
+  read_value(dev, I2C_COMMAND_READ_RAIN_RATE, &sample->rain_rate, sizeof(float), sample);
+  read_value(dev, I2C_COMMAND_READ_RAIN_DAILY, &sample->rain_daily, sizeof(float), sample);
+
+  if (read_value(dev, I2C_COMMAND_READ_RTC, rtc, sizeof(rtc), sample) == 0)
+  {
+    // year msb, year lsb, month, day, dotw, hour, min, sec
+    tm.tm_year = ((rtc[0] << 8) | rtc[1]) - 1900;
+    tm.tm_mon = rtc[2] - 1;
+    tm.tm_mday = rtc[3];
+    tm.tm_hour = rtc[5];
+    tm.tm_min = rtc[6];
+    tm.tm_sec = rtc[7];
+    sample->device_time = timegm(&tm);
+  }
+}
+
+/*
+ * Reuses the ring of a previous instance when it has the same layout, so
+ * that running readers, which keep it mapped, see the samples go on
+ * after a daemon restart. The ring is never unlinked for the same reason.
+ */
+static davis_shm_t *open_shm(const char *name)
+{
+  davis_shm_t *shm;
+  int fd;
+
+  fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(davis_shm_t)) < 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  shm = mmap(NULL, sizeof(davis_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  if (shm->magic == DAVIS_SHM_MAGIC && shm->version == DAVIS_SHM_VERSION &&
+      shm->slots == DAVIS_SHM_SLOTS && shm->sample_size == sizeof(davis_sample_t))
+  {
+    // head and slot locks carry on from where the previous instance stopped
+    return shm;
+  }
+
+  // new, or left by an incompatible version: start from scratch
+  shm->magic = 0;
+  atomic_thread_fence(memory_order_release);
+  memset((uint8_t *)shm + sizeof(shm->magic), 0, sizeof(davis_shm_t) - sizeof(shm->magic));
+  shm->slots = DAVIS_SHM_SLOTS;
+  shm->sample_size = sizeof(davis_sample_t);
+  shm->version = DAVIS_SHM_VERSION;
+  // magic last, readers check it
+  atomic_thread_fence(memory_order_release);
+  shm->magic = DAVIS_SHM_MAGIC;
+
+  return shm;
+}
+
+static void timespec_add_ms(struct timespec *ts, long ms)
+{
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-d i2c_device] [-a address] [-i interval_ms] [-s shm_name] [-n count] [-m]\n"
+          "  -d  i2c adapter, default " DEFAULT_I2C_DEVICE "\n"
+          "  -a  gauge address, default 0x%02x\n"
+          "  -i  polling interval, default %d ms\n"
+          "  -s  shared memory name, default " DAVIS_SHM_NAME "\n"
+          "  -n  exit after count polls, default run forever\n"
+          "  -m  use a mock gauge instead of the i2c bus\n",
+          prog, DEFAULT_I2C_ADDRESS, DEFAULT_INTERVAL_MS);
+}
+
+int main(int argc, char **argv)
+{
+  const char *i2c_device = DEFAULT_I2C_DEVICE;
+  const char *shm_name = DAVIS_SHM_NAME;
+  long interval_ms = DEFAULT_INTERVAL_MS;
+  long count = -1;
+  bool mock = false;
+  davis_device_t dev = {.address = DEFAULT_I2C_ADDRESS, .fd = -1};
+  davis_sample_t sample = {0};
+  davis_shm_t *shm;
+  struct timespec next;
+  struct sigaction sa = {.sa_handler = on_signal};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:a:i:s:n:mh")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      i2c_device = optarg;
+      break;
+    case 'a':
+      dev.address = strtol(optarg, NULL, 0);
+      break;
+    case 'i':
+      interval_ms = strtol(optarg, NULL, 0);
+      break;
+    case 's':
+      shm_name = optarg;
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 0);
+      break;
+    case 'm':
+      mock = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (interval_ms <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (mock)
+  {
+    dev.transfer = mock_transfer;
+  }
+  else
+  {
+    dev.fd = open(i2c_device, O_RDWR);
+    if (dev.fd < 0)
+    {
+      fprintf(stderr, "cannot open %s: %s\n", i2c_device, strerror(errno));
+      return 1;
+    }
+    dev.transfer = i2c_transfer;
+  }
+
+  shm = open_shm(shm_name);
+  if (shm == NULL)
+  {
+    fprintf(stderr, "cannot create shared memory %s: %s\n", shm_name, strerror(errno));
+    return 1;
+  }
+
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // absolute deadlines, so the polling period does not drift with bus time
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (running && count != 0)
+  {
+    poll_device(&dev, &sample);
+    davis_shm_publish(shm, &sample);
+    if (count > 0)
+    {
+      count--;
+    }
+
+    timespec_add_ms(&next, interval_ms);
+    while (running && count != 0 && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+    {
+    }
+  }
+
+  munmap(shm, sizeof(davis_shm_t));
+  if (dev.fd >= 0)
+  {
+    close(dev.fd);
+  }
+
+  return 0;
+}
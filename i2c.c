@@ -1,10 +1,15 @@
 #include <string.h>
-#include <hardware/rtc.h>
 #include <pico/stdlib.h>
 #include <pico/i2c_slave.h>
 #include "i2c.h"
+#include "calendar.h"
+#include "energy.h"
+#include "persist.h"
 #include "wind.h"
+#include "wind_rose.h"
 #include "rain.h"
+#include "rain_histogram.h"
+#include "sample_fifo.h"
 #include "utils.h"
 
 static uint8_t i2c_state = I2C_STATE_IDLE;
@@ -42,6 +47,51 @@ static struct
   uint8_t address;
 } rain_daily_ctx;
 
+/*
+ * Generic block, shared by the commands that move more than a single value:
+ * read commands fill it when started and the master drains it,
+ * write commands collect it and apply it when the master stops.
+ */
+static struct
+{
+  uint8_t mem[I2C_BLOCK_MAX_SIZE];
+  uint16_t size;
+  uint16_t address;
+  uint8_t command;
+} block_ctx;
+
+/*
+ * Burst read of the sample FIFO: one record at a time is copied here,
+ * and removed from the FIFO only once the master has read all of it.
+ */
+static struct
+{
+  sample_record_t record;
+  uint8_t address;
+  bool valid;
+} sample_fifo_ctx;
+
+#ifdef I2C_GENERAL_CALL_ENABLED
+static struct
+{
+  uint8_t mem[I2C_GENERAL_CALL_SIZE];
+  uint8_t address;
+} general_call_ctx;
+
+/* frozen by the last general call latch, read with I2C_COMMAND_READ_LATCHED */
+static struct
+{
+  uint32_t count;
+  uint32_t tag;
+  uint32_t epoch;
+  float wind_speed;
+  int32_t wind_direction;
+  float rain_rate;
+  float rain_daily;
+  int32_t rain_pulses;
+} latched;
+#endif
+
 static void read_windspeed_into_i2c_mem()
 {
   float_to_bytes(wind_speed, wind_speed_ctx.mem);
@@ -77,14 +127,14 @@ static void write_i2c_mem_into_rtc()
       .min = rtc_setting_ctx.mem[6],
       .sec = rtc_setting_ctx.mem[7]};
 
-  rtc_set_datetime(&dt);
+  calendar_set_datetime(&dt);
 }
 
 static void read_rtc_into_i2c_mem()
 {
   datetime_t now;
   uint8_t year_msb, year_lsb;
-  rtc_get_datetime(&now);
+  calendar_get_datetime(&now);
 
   year_msb = now.year >> 8;
   year_lsb = now.year & 0xff;
@@ -108,6 +158,172 @@ static void read_rtc_into_i2c_mem()
   rtc_setting_ctx.address = 0;
 }
 
+static void read_block_into_i2c_mem(uint8_t command)
+{
+  block_ctx.command = command;
+  block_ctx.address = 0;
+
+  switch (command)
+  {
+  case I2C_COMMAND_READ_UTC_OFFSET:
+    int16_to_bytes(calendar_get_utc_offset(), block_ctx.mem);
+    block_ctx.size = sizeof(int16_t);
+    break;
+  case I2C_COMMAND_READ_RTC_DRIFT:
+    int32_to_bytes(calendar_get_drift_ppm(), block_ctx.mem);
+    block_ctx.size = sizeof(int32_t);
+    break;
+  case I2C_COMMAND_READ_REBOOT_INFO:
+    // 1 byte cause, 4 bytes count
+    block_ctx.mem[0] = persist_get_reboot_cause();
+    int32_to_bytes(persist_get_reboot_count(), &block_ctx.mem[1]);
+    block_ctx.size = 1 + sizeof(int32_t);
+    break;
+  case I2C_COMMAND_READ_RAIN_HISTOGRAM:
+    rain_histogram_read(block_ctx.mem);
+    block_ctx.size = RAIN_HISTOGRAM_BLOCK_SIZE;
+    break;
+  case I2C_COMMAND_READ_ENERGY_DIAG:
+    energy_read_diag(block_ctx.mem);
+    block_ctx.size = ENERGY_DIAG_SIZE;
+    break;
+  case I2C_COMMAND_READ_ENERGY_COEFFS:
+    energy_read_coeffs(block_ctx.mem);
+    block_ctx.size = ENERGY_COEFFS_SIZE;
+    break;
+  case I2C_COMMAND_READ_WIND_ROSE:
+    wind_rose_read(block_ctx.mem);
+    block_ctx.size = WIND_ROSE_BLOCK_SIZE;
+    break;
+  case I2C_COMMAND_READ_SAMPLE_FIFO_STATUS:
+    sample_fifo_read_status(block_ctx.mem);
+    block_ctx.size = SAMPLE_FIFO_STATUS_SIZE;
+    break;
+  case I2C_COMMAND_READ_RAIN_CORRECTION:
+    rain_read_correction(block_ctx.mem);
+    block_ctx.size = RAIN_CORRECTION_SIZE;
+    break;
+  case I2C_COMMAND_READ_RAIN_COUNTERS:
+    rain_read_counters(block_ctx.mem);
+    block_ctx.size = RAIN_COUNTERS_SIZE;
+    break;
+#ifdef I2C_GENERAL_CALL_ENABLED
+  case I2C_COMMAND_READ_LATCHED:
+    memcpy(block_ctx.mem, &latched, sizeof(latched));
+    block_ctx.size = I2C_LATCHED_SIZE;
+    break;
+#endif
+  default:
+    block_ctx.size = 0;
+    break;
+  }
+}
+
+static void write_i2c_mem_into_block()
+{
+  switch (block_ctx.command)
+  {
+  case I2C_COMMAND_SET_UTC_OFFSET:
+    if (block_ctx.address == sizeof(int16_t))
+    {
+      calendar_set_utc_offset(bytes_to_int16(block_ctx.mem));
+    }
+    break;
+  case I2C_COMMAND_SET_ENERGY_COEFFS:
+    if (block_ctx.address == ENERGY_COEFFS_SIZE)
+    {
+      energy_set_coeffs(block_ctx.mem);
+    }
+    break;
+  case I2C_COMMAND_SET_SAMPLE_FIFO_CONFIG:
+    if (block_ctx.address == SAMPLE_FIFO_CONFIG_SIZE)
+    {
+      sample_fifo_set_config(block_ctx.mem);
+    }
+    break;
+  case I2C_COMMAND_SET_RAIN_CORRECTION:
+    // enabled flag alone, or with the curve
+    rain_set_correction(block_ctx.mem, block_ctx.address);
+    break;
+  default:
+    break;
+  }
+}
+
+static void start_i2c_block_write(uint8_t command)
+{
+  i2c_state = I2C_STATE_WRITE_BLOCK;
+  block_ctx.command = command;
+  block_ctx.address = 0;
+  block_ctx.size = 0;
+}
+
+static void read_sample_fifo_byte(i2c_inst_t *i2c)
+{
+  uint8_t *mem = (uint8_t *)&sample_fifo_ctx.record;
+
+  if (sample_fifo_ctx.address == 0)
+  {
+    sample_fifo_ctx.valid = sample_fifo_peek(&sample_fifo_ctx.record);
+  }
+
+  // empty FIFO reads as 0xff
+  i2c_write_byte_raw(i2c, sample_fifo_ctx.valid ? mem[sample_fifo_ctx.address] : 0xff);
+  sample_fifo_ctx.address++;
+
+  if (sample_fifo_ctx.address == SAMPLE_FIFO_RECORD_SIZE)
+  {
+    if (sample_fifo_ctx.valid)
+    {
+      sample_fifo_pop(sample_fifo_ctx.record.sequence);
+    }
+    sample_fifo_ctx.address = 0;
+  }
+}
+
+#ifdef I2C_GENERAL_CALL_ENABLED
+/*
+ * The general call reached all the boards at once, so the stop ending it
+ * is the shared sampling instant.
+ */
+static void latch_measurements()
+{
+  uint32_t tag;
+
+  if (general_call_ctx.address != I2C_GENERAL_CALL_SIZE || general_call_ctx.mem[0] != I2C_GENERAL_CALL_LATCH)
+  {
+    return;
+  }
+  memcpy(&tag, &general_call_ctx.mem[1], sizeof(tag));
+
+  latched.count++;
+  latched.tag = tag;
+  latched.epoch = calendar_get_epoch();
+  latched.wind_speed = wind_speed;
+  latched.wind_direction = wind_direction;
+  latched.rain_rate = rain_get_rate();
+  latched.rain_daily = rain_get_daily();
+  latched.rain_pulses = rain_get_pulses();
+}
+
+/* first byte after the general call address, not a command */
+static bool start_i2c_general_call(i2c_inst_t *i2c)
+{
+  if (!(i2c->hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_GEN_CALL_BITS))
+  {
+    return false;
+  }
+  // reading clears it
+  (void)i2c->hw->clr_gen_call;
+
+  i2c_state = I2C_STATE_GENERAL_CALL;
+  general_call_ctx.mem[0] = i2c_read_byte_raw(i2c);
+  general_call_ctx.address = 1;
+
+  return true;
+}
+#endif
+
 static void start_i2c_command(i2c_inst_t *i2c)
 {
   uint8_t command;
@@ -142,6 +358,32 @@ static void start_i2c_command(i2c_inst_t *i2c)
     i2c_state = I2C_STATE_READ_RAIN_DAILY_CMD;
     read_rain_daily_into_i2c_mem();
     break;
+  case I2C_COMMAND_SET_UTC_OFFSET:
+  case I2C_COMMAND_SET_ENERGY_COEFFS:
+  case I2C_COMMAND_SET_SAMPLE_FIFO_CONFIG:
+  case I2C_COMMAND_SET_RAIN_CORRECTION:
+    start_i2c_block_write(command);
+    break;
+  case I2C_COMMAND_READ_UTC_OFFSET:
+  case I2C_COMMAND_READ_RTC_DRIFT:
+  case I2C_COMMAND_READ_REBOOT_INFO:
+  case I2C_COMMAND_READ_RAIN_HISTOGRAM:
+  case I2C_COMMAND_READ_ENERGY_DIAG:
+  case I2C_COMMAND_READ_ENERGY_COEFFS:
+  case I2C_COMMAND_READ_WIND_ROSE:
+  case I2C_COMMAND_READ_SAMPLE_FIFO_STATUS:
+  case I2C_COMMAND_READ_RAIN_CORRECTION:
+  case I2C_COMMAND_READ_RAIN_COUNTERS:
+#ifdef I2C_GENERAL_CALL_ENABLED
+  case I2C_COMMAND_READ_LATCHED:
+#endif
+    i2c_state = I2C_STATE_READ_BLOCK_CMD;
+    read_block_into_i2c_mem(command);
+    break;
+  case I2C_COMMAND_READ_SAMPLE_FIFO:
+    i2c_state = I2C_STATE_READ_SAMPLE_FIFO_CMD;
+    sample_fifo_ctx.address = 0;
+    break;
   default:
     break;
   }
@@ -175,6 +417,47 @@ static void i2c_command_continuation(i2c_inst_t *i2c)
     i2c_write_byte_raw(i2c, rain_daily_ctx.mem[rain_daily_ctx.address]);
     rain_daily_ctx.address++;
     break;
+  case I2C_STATE_WRITE_BLOCK:
+    if (block_ctx.address < I2C_BLOCK_MAX_SIZE)
+    {
+      block_ctx.mem[block_ctx.address] = i2c_read_byte_raw(i2c);
+      block_ctx.address++;
+    }
+    else
+    {
+      // too long, drop the extra bytes
+      i2c_read_byte_raw(i2c);
+    }
+    break;
+  case I2C_STATE_READ_BLOCK:
+    if (block_ctx.address < block_ctx.size)
+    {
+      i2c_write_byte_raw(i2c, block_ctx.mem[block_ctx.address]);
+      block_ctx.address++;
+    }
+    else
+    {
+      // master is reading past the end of the block
+      i2c_write_byte_raw(i2c, 0xff);
+    }
+    break;
+  case I2C_STATE_READ_SAMPLE_FIFO:
+    read_sample_fifo_byte(i2c);
+    break;
+#ifdef I2C_GENERAL_CALL_ENABLED
+  case I2C_STATE_GENERAL_CALL:
+    if (general_call_ctx.address < I2C_GENERAL_CALL_SIZE)
+    {
+      general_call_ctx.mem[general_call_ctx.address] = i2c_read_byte_raw(i2c);
+    }
+    else
+    {
+      // too long, not a latch
+      i2c_read_byte_raw(i2c);
+    }
+    general_call_ctx.address++;
+    break;
+#endif
   default:
     break;
   }
@@ -182,6 +465,11 @@ static void i2c_command_continuation(i2c_inst_t *i2c)
 
 static void i2c_handle_finish(i2c_inst_t *i2c)
 {
+#ifdef I2C_GENERAL_CALL_ENABLED
+  // a general call without data bytes leaves the flag set, it must not leak into the next transaction
+  (void)i2c->hw->clr_gen_call;
+#endif
+
   switch (i2c_state)
   {
   case I2C_STATE_SET_RTC:
@@ -228,6 +516,31 @@ static void i2c_handle_finish(i2c_inst_t *i2c)
   case I2C_STATE_READ_RAIN_DAILY:
     rain_daily_ctx.address = 0;
     break;
+  case I2C_STATE_WRITE_BLOCK:
+    write_i2c_mem_into_block();
+    break;
+  case I2C_STATE_READ_BLOCK_CMD:
+    i2c_state = I2C_STATE_READ_BLOCK;
+    block_ctx.address = 0;
+    return;
+    break;
+  case I2C_STATE_READ_BLOCK:
+    block_ctx.address = 0;
+    break;
+  case I2C_STATE_READ_SAMPLE_FIFO_CMD:
+    i2c_state = I2C_STATE_READ_SAMPLE_FIFO;
+    sample_fifo_ctx.address = 0;
+    return;
+    break;
+  case I2C_STATE_READ_SAMPLE_FIFO:
+    // a partially read record stays in the FIFO
+    sample_fifo_ctx.address = 0;
+    break;
+#ifdef I2C_GENERAL_CALL_ENABLED
+  case I2C_STATE_GENERAL_CALL:
+    latch_measurements();
+    break;
+#endif
   default:
     break;
   }
@@ -237,12 +550,20 @@ static void i2c_handle_finish(i2c_inst_t *i2c)
 
 static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event)
 {
+  uint32_t start = energy_isr_begin();
 
   switch (event)
   {
   case I2C_SLAVE_RECEIVE:
+    energy_count_i2c_byte();
     if (i2c_state == I2C_STATE_IDLE)
     {
+#ifdef I2C_GENERAL_CALL_ENABLED
+      if (start_i2c_general_call(i2c))
+      {
+        break;
+      }
+#endif
       start_i2c_command(i2c);
     }
     else
@@ -251,6 +572,7 @@ static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event)
     }
     break;
   case I2C_SLAVE_REQUEST:
+    energy_count_i2c_byte();
     i2c_command_continuation(i2c);
     break;
   case I2C_SLAVE_FINISH: // master has signalled Stop / Restart
@@ -259,6 +581,8 @@ static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event)
   default:
     break;
   }
+
+  energy_isr_end(ENERGY_SRC_I2C, start);
 }
 
 extern void start_i2c_slave(const uint address, const uint sda_pin, const uint scl_pin)
@@ -279,4 +603,11 @@ extern void setup_i2c_slave(const uint address, const uint sda_pin, const uint s
   i2c_init(I2C_IF, I2C_BAUDRATE);
   // configure I2C interface for slave mode
   i2c_slave_init(I2C_IF, address, &i2c_slave_handler);
+
+  // the controller acks general calls by default, they would be taken for commands
+#ifdef I2C_GENERAL_CALL_ENABLED
+  I2C_IF->hw->ack_general_call = 1;
+#else
+  I2C_IF->hw->ack_general_call = 0;
+#endif
 }
@@ -2,19 +2,28 @@
 #define _I2C_H_
 
 #include <pico/i2c_slave.h>
+#include "board.h"
+#include "i2c_commands.h"
 
+#if BOARD_I2C_INSTANCE == 0
 #define I2C_IF i2c0
+#else
+#define I2C_IF i2c1
+#endif
 #define I2C_BAUDRATE 100000 // 100 kHz
 
-typedef enum
-{
-  I2C_COMMAND_SET_RTC,
-  I2C_COMMAND_READ_RTC,
-  I2C_COMMAND_READ_WIND_SPEED,
-  I2C_COMMAND_READ_WIND_DIRECTION,
-  I2C_COMMAND_READ_RAIN_RATE,
-  I2C_COMMAND_READ_RAIN_DAILY
-} i2c_command_t;
+/* biggest payload a single block command can read or write */
+#define I2C_BLOCK_MAX_SIZE 512
+
+/* general call payload: opcode and tag */
+#define I2C_GENERAL_CALL_SIZE (1 + sizeof(uint32_t))
+
+/*
+ * Latched snapshot, little endian: latch count, tag, epoch (uint32),
+ * wind speed (float), wind direction (int32), rain rate, rain daily (float),
+ * rain pulses (int32). A latch count of 0 means no latch was received yet.
+ */
+#define I2C_LATCHED_SIZE (8 * sizeof(uint32_t))
 
 typedef enum
 {
@@ -29,7 +38,13 @@ typedef enum
   I2C_STATE_READ_RAIN_RATE_CMD,
   I2C_STATE_READ_RAIN_RATE,
   I2C_STATE_READ_RAIN_DAILY_CMD,
-  I2C_STATE_READ_RAIN_DAILY
+  I2C_STATE_READ_RAIN_DAILY,
+  I2C_STATE_WRITE_BLOCK,
+  I2C_STATE_READ_BLOCK_CMD,
+  I2C_STATE_READ_BLOCK,
+  I2C_STATE_READ_SAMPLE_FIFO_CMD,
+  I2C_STATE_READ_SAMPLE_FIFO,
+  I2C_STATE_GENERAL_CALL
 } i2c_state_machine_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,42 @@
+#ifndef _I2C_COMMANDS_H_
+#define _I2C_COMMANDS_H_
+
+/*
+ * I2C protocol commands: the master writes the command byte, then reads
+ * (or keeps writing) the payload. Plain C, shared with the host tools.
+ */
+typedef enum
+{
+  I2C_COMMAND_SET_RTC,
+  I2C_COMMAND_READ_RTC,
+  I2C_COMMAND_READ_WIND_SPEED,
+  I2C_COMMAND_READ_WIND_DIRECTION,
+  I2C_COMMAND_READ_RAIN_RATE,
+  I2C_COMMAND_READ_RAIN_DAILY,
+  I2C_COMMAND_SET_UTC_OFFSET,
+  I2C_COMMAND_READ_UTC_OFFSET,
+  I2C_COMMAND_READ_RTC_DRIFT,
+  I2C_COMMAND_READ_REBOOT_INFO,
+  I2C_COMMAND_READ_RAIN_HISTOGRAM,
+  I2C_COMMAND_READ_ENERGY_DIAG,
+  I2C_COMMAND_SET_ENERGY_COEFFS,
+  I2C_COMMAND_READ_ENERGY_COEFFS,
+  I2C_COMMAND_READ_WIND_ROSE,
+  I2C_COMMAND_SET_SAMPLE_FIFO_CONFIG,
+  I2C_COMMAND_READ_SAMPLE_FIFO_STATUS,
+  I2C_COMMAND_READ_SAMPLE_FIFO,
+  I2C_COMMAND_READ_LATCHED,
+  I2C_COMMAND_SET_RAIN_CORRECTION,
+  I2C_COMMAND_READ_RAIN_CORRECTION,
+  I2C_COMMAND_READ_RAIN_COUNTERS
+} i2c_command_t;
+
+/*
+ * General call (address 0) latch: this opcode followed by a 4 byte tag
+ * chosen by the master. Every board on the bus snapshots its measurements
+ * on the stop, then each one is read with I2C_COMMAND_READ_LATCHED.
+ * Even, and not one of the 0x04/0x06 codes the I2C spec defines.
+ */
+#define I2C_GENERAL_CALL_LATCH 0x4c
+
+#endif
@@ -0,0 +1,152 @@
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include <PicoLed.hpp>
+#include "leds.h"
+#include "energy.h"
+
+#define LED_BRIGHTNESS 20
+/*
+ * WS2812 latches a frame after the data line stays idle for >50us,
+ * keep the led dark for a while between two blinks so they're
+ * still distinguishable.
+ */
+#define LED_BLINK_GAP_MS 5
+
+typedef struct
+{
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint32_t ms;
+} led_blink_t;
+
+/*
+ * Blinks are played by an alarm callback, callers only push into this queue
+ * and get back to work. With a single led the whole frame (24 bits) fits
+ * into the PIO TX FIFO, so show() never stalls the caller.
+ */
+static led_blink_t blink_queue[LEDS_QUEUE_LEN];
+static uint8_t blink_queue_head = 0;
+static uint8_t blink_queue_len = 0;
+/* true while the alarm is playing the queue */
+static bool leds_playing = false;
+static bool led_on = false;
+
+static PicoLed::PicoLedController *led_strip = NULL;
+
+/* Critical sections */
+static critical_section_t leds_crit_sec;
+
+static void leds_show(uint8_t r, uint8_t g, uint8_t b, uint8_t brightness)
+{
+  led_strip->setBrightness(brightness);
+  led_strip->fill(PicoLed::RGB(r, g, b));
+  led_strip->show();
+  energy_led(brightness > 0);
+}
+
+static int64_t leds_play_next()
+{
+  led_blink_t blink;
+  bool pending;
+
+  if (led_on)
+  {
+    // end of a blink: switch off and leave a gap if something else is queued
+    leds_show(0, 0, 0, 0);
+    led_on = false;
+
+    critical_section_enter_blocking(&leds_crit_sec);
+    pending = (blink_queue_len > 0);
+    leds_playing = pending;
+    critical_section_exit(&leds_crit_sec);
+
+    return pending ? LED_BLINK_GAP_MS * 1000 : 0;
+  }
+
+  critical_section_enter_blocking(&leds_crit_sec);
+  if (blink_queue_len == 0)
+  {
+    leds_playing = false;
+    critical_section_exit(&leds_crit_sec);
+    return 0; // nothing left to play
+  }
+  blink = blink_queue[blink_queue_head];
+  blink_queue_head = (blink_queue_head + 1) % LEDS_QUEUE_LEN;
+  blink_queue_len--;
+  critical_section_exit(&leds_crit_sec);
+
+  leds_show(blink.r, blink.g, blink.b, LED_BRIGHTNESS);
+  led_on = true;
+
+  // reschedule when the blink is over
+  return blink.ms * 1000;
+}
+
+static int64_t leds_alarm_callback(alarm_id_t id, void *user_data)
+{
+  uint32_t start = energy_isr_begin();
+  int64_t next = leds_play_next();
+  energy_isr_end(ENERGY_SRC_LEDS, start);
+
+  return next;
+}
+
+extern bool leds_blink(uint8_t r, uint8_t g, uint8_t b, uint32_t ms)
+{
+  bool start;
+  led_blink_t *last;
+
+  if (led_strip == NULL)
+  {
+    return false;
+  }
+
+  critical_section_enter_blocking(&leds_crit_sec);
+  if (blink_queue_len > 0)
+  {
+    // same blink already waiting, no need to queue it twice
+    last = &blink_queue[(blink_queue_head + blink_queue_len - 1) % LEDS_QUEUE_LEN];
+    if (last->r == r && last->g == g && last->b == b && last->ms == ms)
+    {
+      critical_section_exit(&leds_crit_sec);
+      return true;
+    }
+  }
+  if (blink_queue_len == LEDS_QUEUE_LEN)
+  {
+    critical_section_exit(&leds_crit_sec);
+    return false;
+  }
+  blink_queue[(blink_queue_head + blink_queue_len) % LEDS_QUEUE_LEN] = {r, g, b, ms};
+  blink_queue_len++;
+  start = !leds_playing;
+  leds_playing = true;
+  critical_section_exit(&leds_crit_sec);
+
+  if (start)
+  {
+    // the alarm is already due, so the first blink is shown right here
+    // and the alarm is left scheduled for its end.
+    if (add_alarm_in_us(0, &leds_alarm_callback, NULL, true) < 0)
+    {
+      critical_section_enter_blocking(&leds_crit_sec);
+      leds_playing = false;
+      critical_section_exit(&leds_crit_sec);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+extern bool leds_init(uint pin, uint length)
+{
+  critical_section_init(&leds_crit_sec);
+
+  led_strip = new PicoLed::PicoLedController(
+      PicoLed::addLeds<PicoLed::WS2812B>(pio0, 0, pin, length, PicoLed::FORMAT_GRB));
+  leds_show(0, 0, 0, 0);
+
+  return true;
+}
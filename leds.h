@@ -0,0 +1,21 @@
+#ifndef _LEDS_H_
+#define _LEDS_H_
+
+#include <pico/stdlib.h>
+
+/* how many blinks can be waiting to be played, extra ones are dropped */
+#define LEDS_QUEUE_LEN 8
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool leds_init(uint pin, uint length);
+  extern bool leds_blink(uint8_t r, uint8_t g, uint8_t b, uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
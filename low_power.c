@@ -39,3 +39,13 @@ extern void set_low_power()
 
   clock_stop(clk_peri);
 }
+
+/* clk_peri is stopped by set_low_power(), turn it back on for UART users */
+extern void enable_peri_clock()
+{
+  clock_configure(clk_peri,
+                  0,
+                  CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+                  12 * MHZ,
+                  12 * MHZ);
+}
@@ -7,6 +7,7 @@ extern "C"
 #endif
 
   extern void set_low_power();
+  extern void enable_peri_clock();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,132 @@
+#include <stddef.h>
+#include <pico/stdlib.h>
+#include <hardware/watchdog.h>
+#include "persist.h"
+#include "wind.h"
+
+#define PERSIST_MAGIC 0x44575247 // "DWRG"
+/* bump on any change to persist_state_t or the structs in it */
+#define PERSIST_VERSION 5
+
+/*
+ * Two copies written in turn, so a reset in the middle of a save
+ * still leaves the previous one intact.
+ */
+static persist_state_t __uninitialized_ram(persist_slots)[2];
+
+static persist_state_t *restored_state = NULL;
+static persist_reboot_cause_t reboot_cause = PERSIST_REBOOT_POWER_ON;
+static uint32_t reboot_count = 0;
+static uint32_t sequence = 0;
+
+/* FNV-1a, cheap enough to run on every main loop wakeup */
+static uint32_t persist_checksum(const persist_state_t *state)
+{
+  const uint8_t *data = (const uint8_t *)state;
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < offsetof(persist_state_t, checksum); i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static bool persist_valid(const persist_state_t *state)
+{
+  // an image with another layout must not restore misplaced fields
+  return state->magic == PERSIST_MAGIC && state->version == PERSIST_VERSION &&
+         state->size == sizeof(persist_state_t) && state->checksum == persist_checksum(state);
+}
+
+extern bool persist_init()
+{
+  bool valid0 = persist_valid(&persist_slots[0]);
+  bool valid1 = persist_valid(&persist_slots[1]);
+
+  if (valid0 && valid1)
+  {
+    restored_state = ((int32_t)(persist_slots[1].sequence - persist_slots[0].sequence) > 0) ? &persist_slots[1] : &persist_slots[0];
+  }
+  else if (valid0 || valid1)
+  {
+    restored_state = valid0 ? &persist_slots[0] : &persist_slots[1];
+  }
+
+  if (restored_state == NULL)
+  {
+    // RAM content is garbage, this is a power on
+    reboot_cause = PERSIST_REBOOT_POWER_ON;
+    reboot_count = 0;
+    return false;
+  }
+
+  if (watchdog_enable_caused_reboot())
+  {
+    reboot_cause = PERSIST_REBOOT_WATCHDOG;
+  }
+  else if (watchdog_caused_reboot())
+  {
+    reboot_cause = PERSIST_REBOOT_SOFTWARE;
+  }
+  else
+  {
+    reboot_cause = PERSIST_REBOOT_RESET_PIN;
+  }
+
+  reboot_count = restored_state->reboot_count + 1;
+  sequence = restored_state->sequence;
+
+  return true;
+}
+
+/* to be called after the modules are initialised */
+extern void persist_restore()
+{
+  if (restored_state == NULL)
+  {
+    return;
+  }
+
+  calendar_restore_state(&restored_state->calendar);
+  rain_restore_state(&restored_state->rain);
+  rain_histogram_restore_state(&restored_state->rain_histogram);
+  wind_speed = restored_state->wind_speed;
+  wind_direction = restored_state->wind_direction;
+  wind_rose_restore_state(&restored_state->wind_rose);
+  sample_fifo_restore_state(&restored_state->sample_fifo);
+}
+
+extern void persist_save()
+{
+  persist_state_t *state;
+
+  sequence++;
+  state = &persist_slots[sequence & 1];
+
+  state->magic = PERSIST_MAGIC;
+  state->version = PERSIST_VERSION;
+  state->size = sizeof(persist_state_t);
+  state->sequence = sequence;
+  state->reboot_count = reboot_count;
+  rain_save_state(&state->rain);
+  rain_histogram_save_state(&state->rain_histogram);
+  calendar_save_state(&state->calendar);
+  state->wind_speed = wind_speed;
+  state->wind_direction = wind_direction;
+  wind_rose_save_state(&state->wind_rose);
+  sample_fifo_save_state(&state->sample_fifo);
+  state->checksum = persist_checksum(state);
+}
+
+extern persist_reboot_cause_t persist_get_reboot_cause()
+{
+  return reboot_cause;
+}
+
+extern uint32_t persist_get_reboot_count()
+{
+  return reboot_count;
+}
@@ -0,0 +1,59 @@
+#ifndef _PERSIST_H_
+#define _PERSIST_H_
+
+#include <pico/stdlib.h>
+#include "calendar.h"
+#include "rain.h"
+#include "rain_histogram.h"
+#include "sample_fifo.h"
+#include "wind_rose.h"
+
+typedef enum
+{
+  PERSIST_REBOOT_POWER_ON, // cold boot, nothing restored
+  PERSIST_REBOOT_WATCHDOG, // watchdog timeout, something hung
+  PERSIST_REBOOT_SOFTWARE, // reboot requested through watchdog_reboot()
+  PERSIST_REBOOT_RESET_PIN // any other warm reset, RUN pin or debugger
+} persist_reboot_cause_t;
+
+/*
+ * Measurement state kept in RAM that is not cleared on boot, so that
+ * it survives anything but a power loss.
+ *
+ * The clock resumes from the saved time, so a midnight that passed during
+ * the reboot is seen a few seconds late, or when the master sets the time
+ * past it: either way rain_daily_reset() still runs for it.
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t sequence;
+  uint32_t reboot_count;
+  rain_state_t rain;
+  rain_histogram_state_t rain_histogram;
+  calendar_state_t calendar;
+  float wind_speed;
+  int32_t wind_direction;
+  wind_rose_state_t wind_rose;
+  sample_fifo_state_t sample_fifo;
+  uint32_t checksum;
+} persist_state_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool persist_init();
+  extern void persist_restore();
+  extern void persist_save();
+  extern persist_reboot_cause_t persist_get_reboot_cause();
+  extern uint32_t persist_get_reboot_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,11 +1,14 @@
 #include <math.h>
+#include <string.h>
 #include <pico/stdlib.h>
 #include <pico/critical_section.h>
-#include <hardware/rtc.h>
+#include "board.h"
 #include "rain.h"
+#include "rain_histogram.h"
+#include "energy.h"
 
 /* how many mm on rain for each spoon tip */
-#define SPOON_SIZE 0.2
+#define SPOON_SIZE BOARD_SPOON_SIZE
 
 /* Critical sections */
 static critical_section_t bucket_crit_sec;
@@ -17,13 +20,22 @@ int32_t rain_pulses = 0;
 uint64_t rate_last_tip_usec = 0;
 /* debounce vars */
 uint64_t bucket_last_ts_usec = 0;
-uint64_t bucket_bounce_delta_usec = 100 * 1000;
+static const uint64_t bucket_bounce_delta_usec = BOARD_BUCKET_DEBOUNCE_MS * 1000;
+/* any edge, accepted or not, to tell bounces from double tips */
+uint64_t bucket_last_edge_usec = 0;
+uint32_t rain_bounces = 0;
+uint32_t rain_double_tips = 0;
+
+/* intensity correction, always accumulated, reported when enabled */
+float corrected_daily_rain = 0.0;
+static bool correction_enabled = false;
+static uint16_t correction[RAIN_HISTOGRAM_BUCKETS];
 
 /*
  * 15 minutes is defined by the U.S. National Weather Service as intervening time
  * upon which one rain "event" is considered separate from another rain "event".
  */
-#define RAIN_15M_EVENT_MS 15 * 60 * 1000
+#define RAIN_15M_EVENT_MS (15 * 60 * 1000)
 static alarm_id_t rate_15_min_alarm = -1;
 /*
   Using a secondary alarm to smooth out rate when tipping stops,
@@ -36,25 +48,21 @@ static alarm_id_t rate_15_min_alarm = -1;
 static alarm_id_t secondary_rate_alarm = -1;
 uint64_t secondary_rate_alarm_next_msec = 0;
 
-extern void rain_rtc_timer_cb()
+extern void rain_daily_reset()
 {
-  /* called every RTC alarm, which is every 1 minute
-   * Check if is midnight in order to reset daily readings
-   */
-  datetime_t now = {0};
-
-  rtc_get_datetime(&now);
-
-  if (now.hour == 0 && now.min == 0)
-  {
-    daily_rain = 0.0;
-    rain_pulses = 0;
-  }
+  /* called by the calendar at local midnight */
+  critical_section_enter_blocking(&bucket_crit_sec);
+  daily_rain = 0.0;
+  corrected_daily_rain = 0.0;
+  rain_pulses = 0;
+  rain_bounces = 0;
+  rain_double_tips = 0;
+  critical_section_exit(&bucket_crit_sec);
 }
 
 extern float rain_get_daily()
 {
-  return daily_rain;
+  return correction_enabled ? corrected_daily_rain : daily_rain;
 }
 
 extern float rain_get_rate()
@@ -69,6 +77,8 @@ extern int32_t rain_get_pulses()
 
 static int64_t rain_rate_reset(alarm_id_t id, void *user_data)
 {
+  uint32_t start = energy_isr_begin();
+
   if (secondary_rate_alarm > 0)
   {
     cancel_alarm(secondary_rate_alarm);
@@ -79,10 +89,23 @@ static int64_t rain_rate_reset(alarm_id_t id, void *user_data)
   secondary_rate_alarm_next_msec = 0;
   rate_15_min_alarm = -1;
   secondary_rate_alarm = -1;
+  energy_isr_end(ENERGY_SRC_RAIN_ALARMS, start);
 
   return 0; // do not reschedule the alarm
 }
 
+/* rain of a single tip, corrected for the interval since the previous one */
+static float corrected_tip_size(uint32_t interval_msec)
+{
+  uint16_t factor;
+
+  critical_section_enter_blocking(&bucket_crit_sec);
+  factor = correction[rain_histogram_bucket(interval_msec)];
+  critical_section_exit(&bucket_crit_sec);
+
+  return SPOON_SIZE * factor / RAIN_CORRECTION_ONE;
+}
+
 static float compute_rate(uint64_t now, uint64_t last_tip_usec)
 {
   float rate;
@@ -90,14 +113,16 @@ static float compute_rate(uint64_t now, uint64_t last_tip_usec)
   uint64_t hour_msec = 60 * 60 * 1000;
 
   delta_msec = round((now - last_tip_usec) / 1000);
-  rate = (hour_msec / delta_msec) * SPOON_SIZE;
+  rate = (hour_msec / delta_msec) * (correction_enabled ? corrected_tip_size(delta_msec) : SPOON_SIZE);
 
   return rate;
 }
 
 static int64_t secondary_rain_rate_timer(alarm_id_t id, void *user_data)
 {
+  uint32_t start = energy_isr_begin();
   rain_rate = compute_rate(time_us_64(), rate_last_tip_usec);
+  energy_isr_end(ENERGY_SRC_RAIN_ALARMS, start);
 
   // reschedule for same amount. funnily while the alarm interval
   // in expressed in msec when you add it, the return val is in usec.
@@ -127,13 +152,26 @@ static void rain_compute_new_rate()
 extern void rain_gauge_tick()
 {
   uint64_t now = time_us_64();
+  uint64_t since_edge_usec = now - bucket_last_edge_usec;
+
+  bucket_last_edge_usec = now;
 
   if ((now - bucket_last_ts_usec) >= bucket_bounce_delta_usec)
   {
+    // first tip of an event has nothing to correct against
+    float tip_size = SPOON_SIZE;
+
+    // intervals longer than a rain event are just the gap between two events
+    if (bucket_last_ts_usec != 0 && (now - bucket_last_ts_usec) < (uint64_t)RAIN_15M_EVENT_MS * 1000)
+    {
+      rain_histogram_add((now - bucket_last_ts_usec) / 1000);
+      tip_size = corrected_tip_size((now - bucket_last_ts_usec) / 1000);
+    }
     bucket_last_ts_usec = now;
     critical_section_enter_blocking(&bucket_crit_sec);
     rain_pulses++;
     daily_rain = daily_rain + SPOON_SIZE;
+    corrected_daily_rain = corrected_daily_rain + tip_size;
     critical_section_exit(&bucket_crit_sec);
 
     if (rate_15_min_alarm > 0)
@@ -151,11 +189,123 @@ extern void rain_gauge_tick()
 
     rain_compute_new_rate();
   }
+  else
+  {
+    // inside the lockout: a new burst of edges is the bucket tipping again
+    critical_section_enter_blocking(&bucket_crit_sec);
+    if (since_edge_usec < RAIN_BOUNCE_USEC)
+    {
+      rain_bounces++;
+    }
+    else
+    {
+      rain_double_tips++;
+    }
+    critical_section_exit(&bucket_crit_sec);
+  }
 }
 
 extern bool rain_init()
 {
   critical_section_init(&bucket_crit_sec);
+  rain_histogram_init();
+
+  // no correction until the master sets a calibration curve
+  for (int i = 0; i < RAIN_HISTOGRAM_BUCKETS; i++)
+  {
+    correction[i] = RAIN_CORRECTION_ONE;
+  }
+
+  return true;
+}
+
+extern void rain_save_state(rain_state_t *state)
+{
+  uint64_t now = time_us_64();
+
+  critical_section_enter_blocking(&bucket_crit_sec);
+  state->pulses = rain_pulses;
+  state->daily = daily_rain;
+  state->corrected_daily = corrected_daily_rain;
+  state->bounces = rain_bounces;
+  state->double_tips = rain_double_tips;
+  state->correction_enabled = correction_enabled;
+  memcpy(state->correction, correction, sizeof(correction));
+  critical_section_exit(&bucket_crit_sec);
+
+  state->rate = rain_rate;
+  state->rate_interval_msec = secondary_rate_alarm_next_msec;
+  state->last_tip_age_msec = (rate_last_tip_usec == 0) ? 0 : (now - rate_last_tip_usec) / 1000;
+}
+
+extern void rain_restore_state(const rain_state_t *state)
+{
+  uint64_t now = time_us_64();
+
+  critical_section_enter_blocking(&bucket_crit_sec);
+  rain_pulses = state->pulses;
+  daily_rain = state->daily;
+  corrected_daily_rain = state->corrected_daily;
+  rain_bounces = state->bounces;
+  rain_double_tips = state->double_tips;
+  correction_enabled = state->correction_enabled;
+  memcpy(correction, state->correction, sizeof(correction));
+  critical_section_exit(&bucket_crit_sec);
+
+  if (state->last_tip_age_msec == 0 || state->last_tip_age_msec >= RAIN_15M_EVENT_MS)
+  {
+    // no rain event ongoing
+    return;
+  }
+
+  /*
+   * Timer restarted from 0 on reboot, so this may wrap around:
+   * fine, only differences against it are computed.
+   */
+  rain_rate = state->rate;
+  rate_last_tip_usec = now - (uint64_t)state->last_tip_age_msec * 1000;
+  rate_15_min_alarm = add_alarm_in_ms(RAIN_15M_EVENT_MS - state->last_tip_age_msec, &rain_rate_reset, NULL, false);
+  if (state->rate_interval_msec > 0)
+  {
+    secondary_rate_alarm_next_msec = state->rate_interval_msec;
+    secondary_rate_alarm = add_alarm_in_ms(secondary_rate_alarm_next_msec, &secondary_rain_rate_timer, NULL, false);
+  }
+}
+
+/* either just the enabled flag, or the flag and the whole curve */
+extern bool rain_set_correction(const uint8_t *block, uint16_t size)
+{
+  if (size != 1 && size != RAIN_CORRECTION_SIZE)
+  {
+    return false;
+  }
+
+  critical_section_enter_blocking(&bucket_crit_sec);
+  correction_enabled = block[0] != 0;
+  if (size == RAIN_CORRECTION_SIZE)
+  {
+    memcpy(correction, &block[1], sizeof(correction));
+  }
+  critical_section_exit(&bucket_crit_sec);
 
   return true;
-}
\ No newline at end of file
+}
+
+extern void rain_read_correction(uint8_t block[RAIN_CORRECTION_SIZE])
+{
+  critical_section_enter_blocking(&bucket_crit_sec);
+  block[0] = correction_enabled;
+  memcpy(&block[1], correction, sizeof(correction));
+  critical_section_exit(&bucket_crit_sec);
+}
+
+extern void rain_read_counters(uint8_t block[RAIN_COUNTERS_SIZE])
+{
+  critical_section_enter_blocking(&bucket_crit_sec);
+  memcpy(&block[0], &rain_pulses, sizeof(uint32_t));
+  memcpy(&block[4], &rain_bounces, sizeof(uint32_t));
+  memcpy(&block[8], &rain_double_tips, sizeof(uint32_t));
+  memcpy(&block[12], &daily_rain, sizeof(float));
+  memcpy(&block[16], &corrected_daily_rain, sizeof(float));
+  critical_section_exit(&bucket_crit_sec);
+}
@@ -1,6 +1,48 @@
 #ifndef _RAIN_H_
 #define _RAIN_H_
 
+#include <pico/stdlib.h>
+#include "rain_histogram.h"
+
+/*
+ * Intensity correction: tipping buckets lose water while tipping, more so
+ * in heavy rain. Each tip is scaled by a factor picked by the histogram
+ * bucket of the interval since the previous tip, Q12 (4096 = 1.0).
+ */
+#define RAIN_CORRECTION_Q 12
+#define RAIN_CORRECTION_ONE (1 << RAIN_CORRECTION_Q)
+
+/* enabled (uint8) followed by one factor (uint16) per histogram bucket */
+#define RAIN_CORRECTION_SIZE (1 + RAIN_HISTOGRAM_BUCKETS * sizeof(uint16_t))
+
+/*
+ * Edges inside the debounce lockout closer than this to the previous edge
+ * are contact bounces, the others are suspected double tips.
+ */
+#define RAIN_BOUNCE_USEC (20 * 1000)
+
+/*
+ * Counters block, little endian: today tips (int32), bounces, double tips
+ * (uint32), today raw and corrected rain in mm (float)
+ */
+#define RAIN_COUNTERS_SIZE (5 * sizeof(uint32_t))
+
+/* what is needed to resume counting after a warm reboot */
+typedef struct
+{
+  int32_t pulses;
+  float daily;
+  float rate;
+  /* time since last tip, 0 if no rain event is ongoing */
+  uint32_t last_tip_age_msec;
+  uint32_t rate_interval_msec;
+  float corrected_daily;
+  uint32_t bounces;
+  uint32_t double_tips;
+  bool correction_enabled;
+  uint16_t correction[RAIN_HISTOGRAM_BUCKETS];
+} rain_state_t;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -9,9 +51,14 @@ extern "C"
   extern float rain_get_daily();
   extern float rain_get_rate();
   extern int32_t rain_get_pulses();
-  extern void rain_rtc_timer_cb();
+  extern void rain_daily_reset();
   extern void rain_gauge_tick();
   extern bool rain_init();
+  extern void rain_save_state(rain_state_t *state);
+  extern void rain_restore_state(const rain_state_t *state);
+  extern bool rain_set_correction(const uint8_t *block, uint16_t size);
+  extern void rain_read_correction(uint8_t block[RAIN_CORRECTION_SIZE]);
+  extern void rain_read_counters(uint8_t block[RAIN_COUNTERS_SIZE]);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,84 @@
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include "rain_histogram.h"
+
+/* Critical sections */
+static critical_section_t histogram_crit_sec;
+
+static uint16_t today[RAIN_HISTOGRAM_BUCKETS];
+static uint16_t yesterday[RAIN_HISTOGRAM_BUCKETS];
+
+extern uint8_t rain_histogram_bucket(uint32_t interval_msec)
+{
+  uint32_t octave, half, bucket;
+
+  if (interval_msec < (1 << RAIN_HISTOGRAM_MIN_OCTAVE))
+  {
+    return 0;
+  }
+
+  // highest set bit gives the octave, the one below it which half of it
+  octave = 31 - __builtin_clz(interval_msec);
+  half = (interval_msec >> (octave - 1)) & 1;
+
+  bucket = (octave - RAIN_HISTOGRAM_MIN_OCTAVE) * 2 + half;
+  if (bucket >= RAIN_HISTOGRAM_BUCKETS)
+  {
+    return RAIN_HISTOGRAM_BUCKETS - 1;
+  }
+
+  return bucket;
+}
+
+extern void rain_histogram_add(uint32_t interval_msec)
+{
+  uint8_t bucket = rain_histogram_bucket(interval_msec);
+
+  critical_section_enter_blocking(&histogram_crit_sec);
+  if (today[bucket] < UINT16_MAX)
+  {
+    today[bucket]++;
+  }
+  critical_section_exit(&histogram_crit_sec);
+}
+
+extern void rain_histogram_rollover()
+{
+  /* called by the calendar at local midnight */
+  critical_section_enter_blocking(&histogram_crit_sec);
+  memcpy(yesterday, today, sizeof(today));
+  memset(today, 0, sizeof(today));
+  critical_section_exit(&histogram_crit_sec);
+}
+
+extern void rain_histogram_read(uint8_t block[RAIN_HISTOGRAM_BLOCK_SIZE])
+{
+  critical_section_enter_blocking(&histogram_crit_sec);
+  memcpy(block, today, sizeof(today));
+  memcpy(block + sizeof(today), yesterday, sizeof(yesterday));
+  critical_section_exit(&histogram_crit_sec);
+}
+
+extern bool rain_histogram_init()
+{
+  critical_section_init(&histogram_crit_sec);
+
+  return true;
+}
+
+extern void rain_histogram_save_state(rain_histogram_state_t *state)
+{
+  critical_section_enter_blocking(&histogram_crit_sec);
+  memcpy(state->today, today, sizeof(today));
+  memcpy(state->yesterday, yesterday, sizeof(yesterday));
+  critical_section_exit(&histogram_crit_sec);
+}
+
+extern void rain_histogram_restore_state(const rain_histogram_state_t *state)
+{
+  critical_section_enter_blocking(&histogram_crit_sec);
+  memcpy(today, state->today, sizeof(today));
+  memcpy(yesterday, state->yesterday, sizeof(yesterday));
+  critical_section_exit(&histogram_crit_sec);
+}
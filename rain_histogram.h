@@ -0,0 +1,45 @@
+#ifndef _RAIN_HISTOGRAM_H_
+#define _RAIN_HISTOGRAM_H_
+
+#include <pico/stdlib.h>
+
+/*
+ * Distribution of the intervals between two bucket tips, which is
+ * the rain intensity: intensity (mm/h) = SPOON_SIZE * 3600000 / interval (ms).
+ *
+ * Buckets are logarithmic, 2 per power of 2 of the interval in msec,
+ * starting from 64ms (debounce is 100ms). Bucket i covers intervals from
+ *   2^(6 + i / 2) * (1 + (i % 2) / 2)
+ * up to the start of the next one, the last one is open ended.
+ */
+#define RAIN_HISTOGRAM_BUCKETS 32
+#define RAIN_HISTOGRAM_MIN_OCTAVE 6
+
+/* current day buckets followed by previous day ones */
+#define RAIN_HISTOGRAM_BLOCK_SIZE (2 * RAIN_HISTOGRAM_BUCKETS * sizeof(uint16_t))
+
+/* both days, kept across a warm reboot */
+typedef struct
+{
+  uint16_t today[RAIN_HISTOGRAM_BUCKETS];
+  uint16_t yesterday[RAIN_HISTOGRAM_BUCKETS];
+} rain_histogram_state_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern uint8_t rain_histogram_bucket(uint32_t interval_msec);
+  extern void rain_histogram_add(uint32_t interval_msec);
+  extern void rain_histogram_rollover();
+  extern void rain_histogram_read(uint8_t block[RAIN_HISTOGRAM_BLOCK_SIZE]);
+  extern bool rain_histogram_init();
+  extern void rain_histogram_save_state(rain_histogram_state_t *state);
+  extern void rain_histogram_restore_state(const rain_histogram_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
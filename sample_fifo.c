@@ -0,0 +1,233 @@
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include "sample_fifo.h"
+#include "calendar.h"
+#include "rain.h"
+#include "wind.h"
+
+/* Critical sections */
+static critical_section_t fifo_crit_sec;
+
+static sample_record_t records[SAMPLE_FIFO_DEPTH];
+static uint8_t head = 0; // next record to write
+static uint8_t count = 0;
+static uint16_t sequence = 0;
+static uint16_t dropped = 0;
+static uint8_t flags = 0;
+
+static uint8_t odr = SAMPLE_FIFO_DEFAULT_ODR;
+static uint8_t watermark = SAMPLE_FIFO_DEFAULT_WATERMARK;
+
+/* current record accumulation */
+static uint8_t windows = 0;
+static uint32_t windows_pulses = 0;
+static uint32_t gust_pulses = 0;
+
+/* mean over the windows */
+static uint16_t pulses_to_centi_kmh(uint32_t pulses, uint32_t nr_windows)
+{
+  float centi_kmh = pulses * WIND_KMH_PER_PULSE * 100 / nr_windows;
+
+  return centi_kmh < UINT16_MAX ? (uint16_t)centi_kmh : UINT16_MAX;
+}
+
+/* call with fifo_crit_sec held */
+static void update_watermark()
+{
+  if (count >= watermark)
+  {
+    flags |= SAMPLE_FIFO_FLAG_WATERMARK;
+  }
+  else
+  {
+    flags &= ~SAMPLE_FIFO_FLAG_WATERMARK;
+  }
+
+#ifdef SAMPLE_FIFO_INT_PIN
+  gpio_put(SAMPLE_FIFO_INT_PIN, flags & SAMPLE_FIFO_FLAG_WATERMARK);
+#endif
+}
+
+/* call with fifo_crit_sec held */
+static void reset_accumulation()
+{
+  windows = 0;
+  windows_pulses = 0;
+  gust_pulses = 0;
+}
+
+/* called every time a wind window closes */
+extern void sample_fifo_window(uint32_t pulses)
+{
+  sample_record_t record;
+
+  critical_section_enter_blocking(&fifo_crit_sec);
+  if (odr == 0)
+  {
+    critical_section_exit(&fifo_crit_sec);
+    return;
+  }
+
+  windows++;
+  windows_pulses += pulses;
+  if (pulses > gust_pulses)
+  {
+    gust_pulses = pulses;
+  }
+  if (windows < odr)
+  {
+    critical_section_exit(&fifo_crit_sec);
+    return;
+  }
+
+  record.speed_centi_kmh = pulses_to_centi_kmh(windows_pulses, windows);
+  record.gust_centi_kmh = pulses_to_centi_kmh(gust_pulses, 1);
+  reset_accumulation();
+  critical_section_exit(&fifo_crit_sec);
+
+  // calendar takes its own lock
+  record.epoch = calendar_get_epoch();
+  record.rain_pulses = rain_get_pulses();
+  record.direction = wind_direction;
+
+  critical_section_enter_blocking(&fifo_crit_sec);
+  record.sequence = sequence++;
+  if (count == SAMPLE_FIFO_DEPTH)
+  {
+    // drop the oldest, the master wants the most recent data
+    count--;
+    flags |= SAMPLE_FIFO_FLAG_OVERFLOW;
+    if (dropped < UINT16_MAX)
+    {
+      dropped++;
+    }
+  }
+  records[head] = record;
+  head = (head + 1) % SAMPLE_FIFO_DEPTH;
+  count++;
+  update_watermark();
+  critical_section_exit(&fifo_crit_sec);
+}
+
+/* oldest record, false if empty */
+extern bool sample_fifo_peek(sample_record_t *record)
+{
+  bool res = false;
+
+  critical_section_enter_blocking(&fifo_crit_sec);
+  if (count > 0)
+  {
+    *record = records[(head + SAMPLE_FIFO_DEPTH - count) % SAMPLE_FIFO_DEPTH];
+    res = true;
+  }
+  critical_section_exit(&fifo_crit_sec);
+
+  return res;
+}
+
+/*
+ * Removes the oldest record once the master has read it all, unless an
+ * overflow already dropped it in the meantime.
+ */
+extern void sample_fifo_pop(uint16_t read_sequence)
+{
+  critical_section_enter_blocking(&fifo_crit_sec);
+  if (count > 0 && records[(head + SAMPLE_FIFO_DEPTH - count) % SAMPLE_FIFO_DEPTH].sequence == read_sequence)
+  {
+    count--;
+    update_watermark();
+  }
+  critical_section_exit(&fifo_crit_sec);
+}
+
+extern void sample_fifo_read_status(uint8_t block[SAMPLE_FIFO_STATUS_SIZE])
+{
+  critical_section_enter_blocking(&fifo_crit_sec);
+  block[0] = count;
+  block[1] = watermark;
+  block[2] = odr;
+  block[3] = flags;
+  memcpy(&block[4], &dropped, sizeof(dropped));
+
+  // read to clear
+  flags &= ~SAMPLE_FIFO_FLAG_OVERFLOW;
+  dropped = 0;
+  critical_section_exit(&fifo_crit_sec);
+}
+
+/* a new configuration also empties the FIFO */
+extern bool sample_fifo_set_config(const uint8_t block[SAMPLE_FIFO_CONFIG_SIZE])
+{
+  if (block[1] == 0 || block[1] > SAMPLE_FIFO_DEPTH)
+  {
+    return false;
+  }
+
+  critical_section_enter_blocking(&fifo_crit_sec);
+  odr = block[0];
+  watermark = block[1];
+  count = 0;
+  dropped = 0;
+  flags = 0;
+  reset_accumulation();
+  update_watermark();
+  critical_section_exit(&fifo_crit_sec);
+
+  return true;
+}
+
+extern void sample_fifo_save_state(sample_fifo_state_t *state)
+{
+  critical_section_enter_blocking(&fifo_crit_sec);
+  memcpy(state->records, records, sizeof(records));
+  state->head = head;
+  state->count = count;
+  state->sequence = sequence;
+  state->dropped = dropped;
+  state->flags = flags;
+  state->odr = odr;
+  state->watermark = watermark;
+  state->windows = windows;
+  state->windows_pulses = windows_pulses;
+  state->gust_pulses = gust_pulses;
+  critical_section_exit(&fifo_crit_sec);
+}
+
+extern void sample_fifo_restore_state(const sample_fifo_state_t *state)
+{
+  if (state->head >= SAMPLE_FIFO_DEPTH || state->count > SAMPLE_FIFO_DEPTH ||
+      state->watermark == 0 || state->watermark > SAMPLE_FIFO_DEPTH)
+  {
+    return;
+  }
+
+  critical_section_enter_blocking(&fifo_crit_sec);
+  memcpy(records, state->records, sizeof(records));
+  head = state->head;
+  count = state->count;
+  // sequence goes on, so the master sees no jump unless records were really dropped
+  sequence = state->sequence;
+  dropped = state->dropped;
+  flags = state->flags;
+  odr = state->odr;
+  watermark = state->watermark;
+  windows = state->windows;
+  windows_pulses = state->windows_pulses;
+  gust_pulses = state->gust_pulses;
+  update_watermark();
+  critical_section_exit(&fifo_crit_sec);
+}
+
+extern bool sample_fifo_init()
+{
+  critical_section_init(&fifo_crit_sec);
+
+#ifdef SAMPLE_FIFO_INT_PIN
+  gpio_init(SAMPLE_FIFO_INT_PIN);
+  gpio_set_dir(SAMPLE_FIFO_INT_PIN, GPIO_OUT);
+  gpio_put(SAMPLE_FIFO_INT_PIN, 0);
+#endif
+
+  return true;
+}
@@ -0,0 +1,83 @@
+#ifndef _SAMPLE_FIFO_H_
+#define _SAMPLE_FIFO_H_
+
+#include <pico/stdlib.h>
+
+/*
+ * Sample FIFO: every `odr` wind windows (WIND_SAMPLER_SECS each) a record is
+ * queued, so the master can sleep and drain a batch later without gaps.
+ * When full the oldest record is dropped and the overflow flag is set.
+ */
+#define SAMPLE_FIFO_DEPTH 64
+#define SAMPLE_FIFO_DEFAULT_ODR 1
+#define SAMPLE_FIFO_DEFAULT_WATERMARK (SAMPLE_FIFO_DEPTH / 2)
+
+/* driven high while the FIFO holds at least watermark records */
+// #define SAMPLE_FIFO_INT_PIN 2
+
+/*
+ * Record, little endian: epoch (uint32), rain pulses since local midnight
+ * (uint32, drops to 0 at the daily reset, kept across warm reboots),
+ * sequence (uint16, wraps, a jump means dropped records), mean and gust
+ * (best window) speed in km/h * 100 (uint16), direction in degrees (uint16)
+ */
+typedef struct
+{
+  uint32_t epoch;
+  uint32_t rain_pulses;
+  uint16_t sequence;
+  uint16_t speed_centi_kmh;
+  uint16_t gust_centi_kmh;
+  uint16_t direction;
+} sample_record_t;
+
+#define SAMPLE_FIFO_RECORD_SIZE sizeof(sample_record_t)
+
+/* what is needed to keep the unread records and the setup across a warm reboot */
+typedef struct
+{
+  sample_record_t records[SAMPLE_FIFO_DEPTH];
+  uint8_t head;
+  uint8_t count;
+  uint16_t sequence;
+  uint16_t dropped;
+  uint8_t flags;
+  uint8_t odr;
+  uint8_t watermark;
+  uint8_t windows;
+  uint32_t windows_pulses;
+  uint32_t gust_pulses;
+} sample_fifo_state_t;
+
+/* status flags */
+#define SAMPLE_FIFO_FLAG_WATERMARK 0x01
+#define SAMPLE_FIFO_FLAG_OVERFLOW 0x02
+
+/*
+ * Status block: count, watermark, odr, flags (uint8), dropped records
+ * since the last status read (uint16). Reading it clears the overflow.
+ */
+#define SAMPLE_FIFO_STATUS_SIZE (4 + sizeof(uint16_t))
+
+/* Config block: odr in wind windows per record (0 stops sampling), watermark */
+#define SAMPLE_FIFO_CONFIG_SIZE 2
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool sample_fifo_init();
+  extern void sample_fifo_window(uint32_t pulses);
+  extern bool sample_fifo_set_config(const uint8_t block[SAMPLE_FIFO_CONFIG_SIZE]);
+  extern void sample_fifo_read_status(uint8_t block[SAMPLE_FIFO_STATUS_SIZE]);
+  extern bool sample_fifo_peek(sample_record_t *record);
+  extern void sample_fifo_pop(uint16_t sequence);
+  extern void sample_fifo_save_state(sample_fifo_state_t *state);
+  extern void sample_fifo_restore_state(const sample_fifo_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
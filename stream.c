@@ -0,0 +1,235 @@
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/uart.h>
+#include "stream.h"
+#include "energy.h"
+#include "low_power.h"
+#include "rain.h"
+#include "wind.h"
+
+#define STREAM_RING_MASK (STREAM_RING_SIZE - 1)
+/* sync, type, length and checksum */
+#define STREAM_FRAME_OVERHEAD 6
+
+typedef struct
+{
+  uint32_t pos;
+  uint16_t sum1;
+  uint16_t sum2;
+} stream_writer_t;
+
+/*
+ * Records are encoded straight into the ring and the DMA sends them
+ * from there to the UART, the cpu never copies or waits for the line.
+ * head and tail are free running, only masked when indexing.
+ */
+static uint8_t stream_ring[STREAM_RING_SIZE];
+static uint32_t ring_head = 0;
+static uint32_t ring_tail = 0;
+/* bytes handed to the DMA, 0 when idle */
+static uint32_t dma_len = 0;
+static int dma_chan = -1;
+static bool stream_active = false;
+static uint32_t dropped_records = 0;
+
+/* Critical sections */
+static critical_section_t stream_crit_sec;
+
+/* must be called with the critical section held */
+static void stream_kick_dma()
+{
+  uint32_t start, len;
+
+  if (dma_len > 0 || ring_head == ring_tail)
+  {
+    return;
+  }
+
+  // send up to the end of the ring, the rest goes with the next transfer
+  start = ring_tail & STREAM_RING_MASK;
+  len = ring_head - ring_tail;
+  if (len > STREAM_RING_SIZE - start)
+  {
+    len = STREAM_RING_SIZE - start;
+  }
+
+  dma_len = len;
+  dma_channel_transfer_from_buffer_now(dma_chan, &stream_ring[start], len);
+}
+
+static void stream_dma_irq_handler()
+{
+  if (!dma_channel_get_irq0_status(dma_chan))
+  {
+    return;
+  }
+  uint32_t start = energy_isr_begin();
+  dma_channel_acknowledge_irq0(dma_chan);
+
+  critical_section_enter_blocking(&stream_crit_sec);
+  ring_tail += dma_len;
+  dma_len = 0;
+  stream_kick_dma();
+  critical_section_exit(&stream_crit_sec);
+  energy_isr_end(ENERGY_SRC_STREAM, start);
+}
+
+static void stream_put(stream_writer_t *w, const void *data, uint8_t len)
+{
+  const uint8_t *bytes = data;
+
+  for (uint8_t i = 0; i < len; i++)
+  {
+    stream_ring[w->pos & STREAM_RING_MASK] = bytes[i];
+    w->pos++;
+
+    // fletcher16
+    w->sum1 += bytes[i];
+    if (w->sum1 >= 255)
+    {
+      w->sum1 -= 255;
+    }
+    w->sum2 += w->sum1;
+    if (w->sum2 >= 255)
+    {
+      w->sum2 -= 255;
+    }
+  }
+}
+
+/*
+ * Reserves room for a whole record and writes its header,
+ * leaves the critical section held only on success.
+ */
+static bool stream_begin(stream_writer_t *w, stream_record_t type, uint8_t len)
+{
+  uint8_t header[] = {(uint8_t)type, len};
+
+  if (!stream_active)
+  {
+    return false;
+  }
+
+  critical_section_enter_blocking(&stream_crit_sec);
+  if (STREAM_RING_SIZE - (ring_head - ring_tail) < (uint32_t)len + STREAM_FRAME_OVERHEAD)
+  {
+    // line can't keep up, the host sees it in the aggregate records
+    dropped_records++;
+    critical_section_exit(&stream_crit_sec);
+    return false;
+  }
+
+  w->pos = ring_head;
+  stream_ring[w->pos & STREAM_RING_MASK] = STREAM_SYNC_0;
+  w->pos++;
+  stream_ring[w->pos & STREAM_RING_MASK] = STREAM_SYNC_1;
+  w->pos++;
+  w->sum1 = 0;
+  w->sum2 = 0;
+  stream_put(w, header, sizeof(header));
+
+  return true;
+}
+
+static void stream_end(stream_writer_t *w)
+{
+  uint8_t checksum[] = {(uint8_t)w->sum1, (uint8_t)w->sum2};
+
+  stream_ring[w->pos & STREAM_RING_MASK] = checksum[0];
+  w->pos++;
+  stream_ring[w->pos & STREAM_RING_MASK] = checksum[1];
+  w->pos++;
+
+  ring_head = w->pos;
+  stream_kick_dma();
+  critical_section_exit(&stream_crit_sec);
+}
+
+extern void stream_edge(stream_edge_source_t source, uint32_t ts_usec)
+{
+  stream_writer_t w;
+  uint8_t src = source;
+
+  if (!stream_begin(&w, STREAM_RECORD_EDGE, sizeof(src) + sizeof(ts_usec)))
+  {
+    return;
+  }
+  stream_put(&w, &src, sizeof(src));
+  stream_put(&w, &ts_usec, sizeof(ts_usec));
+  stream_end(&w);
+}
+
+extern void stream_adc(uint8_t input, uint16_t value, uint32_t ts_usec)
+{
+  stream_writer_t w;
+
+  if (!stream_begin(&w, STREAM_RECORD_ADC, sizeof(input) + sizeof(value) + sizeof(ts_usec)))
+  {
+    return;
+  }
+  stream_put(&w, &input, sizeof(input));
+  stream_put(&w, &value, sizeof(value));
+  stream_put(&w, &ts_usec, sizeof(ts_usec));
+  stream_end(&w);
+}
+
+extern void stream_aggregate()
+{
+  stream_writer_t w;
+  uint32_t ts_usec;
+  float speed = wind_speed;
+  int32_t direction = wind_direction;
+  float rate = rain_get_rate();
+  float daily = rain_get_daily();
+  int32_t pulses = rain_get_pulses();
+
+  if (!stream_begin(&w, STREAM_RECORD_AGGREGATE, 7 * sizeof(uint32_t)))
+  {
+    return;
+  }
+  // taken in the critical section, so it can't be older than a record queued before
+  ts_usec = time_us_32();
+  stream_put(&w, &ts_usec, sizeof(ts_usec));
+  stream_put(&w, &speed, sizeof(speed));
+  stream_put(&w, &direction, sizeof(direction));
+  stream_put(&w, &rate, sizeof(rate));
+  stream_put(&w, &daily, sizeof(daily));
+  stream_put(&w, &pulses, sizeof(pulses));
+  stream_put(&w, &dropped_records, sizeof(dropped_records));
+  stream_end(&w);
+}
+
+extern bool stream_init()
+{
+  dma_channel_config c;
+
+  critical_section_init(&stream_crit_sec);
+
+  dma_chan = dma_claim_unused_channel(false);
+  if (dma_chan < 0)
+  {
+    return false;
+  }
+
+  // uart is clocked by clk_peri, which is off in low power mode
+  enable_peri_clock();
+  uart_init(STREAM_UART, STREAM_BAUDRATE);
+  gpio_set_function(STREAM_TX_PIN, GPIO_FUNC_UART);
+
+  c = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, uart_get_dreq(STREAM_UART, true));
+  dma_channel_configure(dma_chan, &c, &uart_get_hw(STREAM_UART)->dr, NULL, 0, false);
+
+  dma_channel_set_irq0_enabled(dma_chan, true);
+  irq_add_shared_handler(DMA_IRQ_0, stream_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+
+  stream_active = true;
+
+  return true;
+}
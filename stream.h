@@ -0,0 +1,54 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <pico/stdlib.h>
+#include "board.h"
+
+/*
+ * Binary streaming of raw data, for calibration runs.
+ * Enabled at build time with -DDAVIS_STREAM=ON, see tools/stream_decode.py
+ * for the host side.
+ *
+ * Frame layout, little endian:
+ *   0xA5 0x5A | type (1) | payload length (1) | payload | fletcher16 (2)
+ * checksum covers type, length and payload.
+ */
+#define STREAM_UART uart1
+#define STREAM_TX_PIN BOARD_STREAM_TX_PIN
+/* clk_peri runs at 12MHz, so 750kbaud is the max */
+#define STREAM_BAUDRATE 460800
+/* must be a power of 2 */
+#define STREAM_RING_SIZE 2048
+
+#define STREAM_SYNC_0 0xA5
+#define STREAM_SYNC_1 0x5A
+
+typedef enum
+{
+  STREAM_RECORD_EDGE = 1,      // source (1), timestamp usec (4)
+  STREAM_RECORD_ADC = 2,       // input (1), raw value (2), timestamp usec (4)
+  STREAM_RECORD_AGGREGATE = 3, // timestamp usec (4), wind speed (f4), wind direction (4),
+                               // rain rate (f4), daily rain (f4), rain pulses (4), dropped records (4)
+} stream_record_t;
+
+typedef enum
+{
+  STREAM_EDGE_RAIN = 0,
+  STREAM_EDGE_WIND = 1
+} stream_edge_source_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool stream_init();
+  extern void stream_edge(stream_edge_source_t source, uint32_t ts_usec);
+  extern void stream_adc(uint8_t input, uint16_t value, uint32_t ts_usec);
+  extern void stream_aggregate();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""
+Decoder for the binary stream sent by firmwares built with -DDAVIS_STREAM=ON.
+
+Reads frames from a serial port (or any tty, a pty works too) and prints one
+CSV line per record. Frame layout is described in stream.h.
+
+    ./stream_decode.py /dev/ttyUSB0
+
+To try it without hardware, create a pty pair and feed it fake records:
+
+    socat -d -d pty,raw,echo=0 pty,raw,echo=0
+    ./stream_decode.py --simulate /dev/pts/3 &
+    ./stream_decode.py /dev/pts/4
+"""
+
+import argparse
+import os
+import struct
+import sys
+import termios
+import time
+
+SYNC = b"\xa5\x5a"
+BAUDRATE = 460800
+
+RECORD_EDGE = 1
+RECORD_ADC = 2
+RECORD_AGGREGATE = 3
+
+EDGE_SOURCES = {0: "rain", 1: "wind"}
+
+# payload layout of each record type, little endian
+RECORD_FORMATS = {
+    RECORD_EDGE: "<BI",
+    RECORD_ADC: "<BHI",
+    RECORD_AGGREGATE: "<IfiffiI",
+}
+
+
+def fletcher16(data):
+    sum1 = sum2 = 0
+    for byte in data:
+        sum1 = (sum1 + byte) % 255
+        sum2 = (sum2 + sum1) % 255
+    return bytes([sum1, sum2])
+
+
+def encode(record_type, *fields):
+    payload = struct.pack(RECORD_FORMATS[record_type], *fields)
+    body = bytes([record_type, len(payload)]) + payload
+    return SYNC + body + fletcher16(body)
+
+
+class Decoder:
+    """Splits a byte stream into records, resyncing on garbage."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.bad_frames = 0
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                # keep a possible first half of the sync
+                del self.buf[:-1]
+                return
+            del self.buf[:start]
+            if len(self.buf) < 4:
+                return
+            record_type, length = self.buf[2], self.buf[3]
+            end = 4 + length + 2
+            if len(self.buf) < end:
+                return
+            body = bytes(self.buf[2:4 + length])
+            if bytes(self.buf[4 + length:end]) != fletcher16(body):
+                # not a frame, skip this sync and look for the next one
+                self.bad_frames += 1
+                del self.buf[:1]
+                continue
+            del self.buf[:end]
+            fmt = RECORD_FORMATS.get(record_type)
+            if fmt is None or struct.calcsize(fmt) != length:
+                self.bad_frames += 1
+                continue
+            yield record_type, struct.unpack(fmt, body[2:])
+
+
+class Unwrapper:
+    """Firmware timestamps are 32 bit usec, wrapping every ~71 minutes.
+
+    Records may arrive slightly out of order (an irq preempting another
+    between taking its timestamp and queueing its record), so each one is
+    placed by its signed 32 bit distance from the latest seen, and only
+    a forward move advances it.
+    """
+
+    def __init__(self):
+        self.last = None
+
+    def __call__(self, ts):
+        if self.last is None:
+            self.last = ts
+            return ts
+        delta = ((ts - self.last + (1 << 31)) & 0xffffffff) - (1 << 31)
+        unwrapped = self.last + delta
+        if delta > 0:
+            self.last = unwrapped
+        return unwrapped
+
+
+def format_record(record_type, fields, unwrap):
+    if record_type == RECORD_EDGE:
+        source, ts = fields
+        return "edge,%d,%s" % (unwrap(ts), EDGE_SOURCES.get(source, source))
+    if record_type == RECORD_ADC:
+        adc_input, value, ts = fields
+        return "adc,%d,%d,%d" % (unwrap(ts), adc_input, value)
+    ts, speed, direction, rate, daily, pulses, dropped = fields
+    return "aggregate,%d,%.2f,%d,%.2f,%.2f,%d,%d" % (
+        unwrap(ts), speed, direction, rate, daily, pulses, dropped)
+
+
+def open_tty(path, baudrate):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attrs = termios.tcgetattr(fd)
+    # raw mode: no echo, no line editing, no translations
+    attrs[0] = 0
+    attrs[1] = 0
+    attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attrs[3] = 0
+    speed = getattr(termios, "B%d" % baudrate, None)
+    if speed is not None:
+        attrs[4] = attrs[5] = speed
+    attrs[6][termios.VMIN] = 1
+    attrs[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def decode(path, baudrate):
+    fd = open_tty(path, baudrate)
+    decoder = Decoder()
+    unwrap = Unwrapper()
+    print("record,timestamp_usec,...")
+    try:
+        while True:
+            data = os.read(fd, 4096)
+            if not data:
+                break
+            for record_type, fields in decoder.feed(data):
+                print(format_record(record_type, fields, unwrap), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+    if decoder.bad_frames:
+        print("bad frames: %d" % decoder.bad_frames, file=sys.stderr)
+
+
+def simulate(path, baudrate):
+    """Writes fake records, as the firmware would, for testing the decoder."""
+    fd = open_tty(path, baudrate)
+    start = time.monotonic()
+    pulses = 0
+    try:
+        while True:
+            ts = int((time.monotonic() - start) * 1e6) & 0xffffffff
+            frames = encode(RECORD_EDGE, 1, ts)
+            frames += encode(RECORD_ADC, 3, 2048, ts)
+            if int(ts / 1e6) % 3 == 0:
+                pulses += 1
+                frames += encode(RECORD_EDGE, 0, ts)
+                frames += encode(RECORD_AGGREGATE, ts, 12.5, 180, 2.4, pulses * 0.2, pulses, 0)
+            os.write(fd, frames)
+            time.sleep(0.5)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("tty", help="serial port or pty to read from")
+    parser.add_argument("--baudrate", type=int, default=BAUDRATE)
+    parser.add_argument("--simulate", action="store_true", help="write fake records to the tty instead of reading")
+    args = parser.parse_args()
+
+    if args.simulate:
+        simulate(args.tty, args.baudrate)
+    else:
+        decode(args.tty, args.baudrate)
+
+
+if __name__ == "__main__":
+    main()
@@ -33,4 +33,18 @@ void float_to_bytes(float val, uint8_t bytes_array[sizeof(float)])
 
   // Assign bytes to input array
   memcpy(bytes_array, u.temp_array, sizeof(float));
-}
\ No newline at end of file
+}
+
+void int16_to_bytes(int16_t val, uint8_t bytes_array[sizeof(int16_t)])
+{
+  memcpy(bytes_array, &val, sizeof(int16_t));
+}
+
+int16_t bytes_to_int16(const uint8_t bytes_array[sizeof(int16_t)])
+{
+  int16_t val;
+
+  memcpy(&val, bytes_array, sizeof(int16_t));
+
+  return val;
+}
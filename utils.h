@@ -11,6 +11,8 @@ extern "C"
   extern int32_t map(int32_t x, int32_t in_min, int32_t in_max, int32_t out_min, int32_t out_max);
   extern void int32_to_bytes(int32_t val, uint8_t bytes_array[sizeof(int32_t)]);
   extern void float_to_bytes(float val, uint8_t bytes_array[sizeof(float)]);
+  extern void int16_to_bytes(int16_t val, uint8_t bytes_array[sizeof(int16_t)]);
+  extern int16_t bytes_to_int16(const uint8_t bytes_array[sizeof(int16_t)]);
 
 #ifdef __cplusplus
 }
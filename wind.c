@@ -3,15 +3,18 @@
 #include <pico/critical_section.h>
 #include "wind.h"
 #include "utils.h"
-
-#define MPH_CONV_CONSTANT 1.60934
+#include "stream.h"
+#include "energy.h"
+#include "wind_rose.h"
+#include "sample_fifo.h"
 
 uint8_t wind_adc_input_nr;
 int32_t wind_pulses = 0;
 float wind_speed = 0;
 int32_t wind_direction;
+uint16_t wind_vane_reading = 0;
 uint64_t wind_last_ts_usec = 0;
-uint64_t wind_bounce_delta_usec = 20 * 1000;
+static const uint64_t wind_bounce_delta_usec = BOARD_WIND_DEBOUNCE_MS * 1000;
 
 struct repeating_timer wind_speed_timer;
 struct repeating_timer wind_direction_timer;
@@ -23,17 +26,24 @@ static void wind_read_direction()
 {
   adc_select_input(wind_adc_input_nr);
   uint16_t vane_reading = adc_read();
+  energy_count_adc();
+  stream_adc(wind_adc_input_nr, vane_reading, time_us_32());
 
   // from pico-sdk docs:
   // 12-bit conversion, assume max value == ADC_VREF == 3.3 V
   // const float conversion_factor = 3.3f / (1 << 12);
 
+  // raw reading for the wind rose, sector is computed from it
+  wind_vane_reading = vane_reading;
+
   // map 0-4095 to 0-360
   wind_direction = map(vane_reading, 0, 4095, 0, 360);
 }
 
 static bool windspeed_timer_callback(struct repeating_timer *t)
 {
+  uint32_t start = energy_isr_begin();
+
   /*
    * Davis reports that 1600 rotations hour = 1 mph
    * so convert to mp/h using the Davis formula V=P(2.25/T)
@@ -45,16 +55,25 @@ static bool windspeed_timer_callback(struct repeating_timer *t)
    */
 
   critical_section_enter_blocking(&wind_crit_sec);
-  wind_speed = (wind_pulses * (2.25 / WIND_SAMPLER_SECS)) * MPH_CONV_CONSTANT;
+  uint32_t pulses = wind_pulses;
+  wind_speed = pulses * WIND_KMH_PER_PULSE;
   wind_pulses = 0;
   critical_section_exit(&wind_crit_sec);
 
+  wind_rose_add(pulses, wind_vane_reading);
+  sample_fifo_window(pulses);
+
+  stream_aggregate();
+  energy_isr_end(ENERGY_SRC_WIND_TIMERS, start);
+
   return true;
 }
 
 static bool winddirection_timer_callback(struct repeating_timer *t)
 {
+  uint32_t start = energy_isr_begin();
   wind_read_direction();
+  energy_isr_end(ENERGY_SRC_WIND_TIMERS, start);
 
   return true;
 }
@@ -75,6 +94,7 @@ extern void wind_speed_tick()
 extern bool wind_init(uint8_t adc_input_nr)
 {
   critical_section_init(&wind_crit_sec);
+  wind_rose_init();
 
   wind_adc_input_nr = adc_input_nr;
 
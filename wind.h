@@ -1,8 +1,13 @@
 #ifndef _WIND_H_
 #define _WIND_H_
 
-#define WIND_SAMPLER_SECS 3
+#include "board.h"
+
+#define WIND_SAMPLER_SECS BOARD_WIND_SAMPLER_SECS
 #define WIND_DIR_SAMPLER_SECS 1
+#define MPH_CONV_CONSTANT 1.60934
+/* km/h of a single pulse in a window, see windspeed_timer_callback() */
+#define WIND_KMH_PER_PULSE ((2.25 / WIND_SAMPLER_SECS) * MPH_CONV_CONSTANT)
 
 extern float wind_speed;
 extern int32_t wind_direction;
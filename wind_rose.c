@@ -0,0 +1,134 @@
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include "wind_rose.h"
+#include "wind.h"
+#include "utils.h"
+
+/* pulses per window above this are all in the last speed bin */
+#define WIND_ROSE_PULSES_LUT_SIZE 64
+
+/* Critical sections */
+static critical_section_t rose_crit_sec;
+
+static uint16_t hour_rose[WIND_ROSE_SECTORS][WIND_ROSE_SPEED_BINS];
+static uint16_t day_rose[WIND_ROSE_SECTORS][WIND_ROSE_SPEED_BINS];
+
+/* pulses in a window -> speed bin, no float maths when a window closes */
+static uint8_t speed_bin_lut[WIND_ROSE_PULSES_LUT_SIZE];
+#ifdef WIND_ROSE_SECTOR_LUT
+/* 12 bit ADC code >> 4 -> sector */
+static uint8_t sector_lut[4096 >> 4];
+#endif
+
+static const float speed_bin_bounds_kmh[WIND_ROSE_SPEED_BINS - 1] = {2, 6, 12, 20, 29, 39, 50};
+
+static uint8_t wind_rose_sector(uint16_t vane_reading)
+{
+  // same degrees as wind_direction, then round to the closest sector
+  int32_t degrees = map(vane_reading, 0, 4095, 0, 360) + WIND_VANE_OFFSET_DEG;
+
+  // back into 0-359, the offset may be negative
+  degrees = ((degrees % 360) + 360) % 360;
+
+  return (((degrees * WIND_ROSE_SECTORS + 180) / 360) % WIND_ROSE_SECTORS);
+}
+
+static uint8_t wind_rose_speed_bin(uint32_t pulses)
+{
+  if (pulses >= WIND_ROSE_PULSES_LUT_SIZE)
+  {
+    return WIND_ROSE_SPEED_BINS - 1;
+  }
+
+  return speed_bin_lut[pulses];
+}
+
+static void inc_saturated(uint16_t *counter)
+{
+  if (*counter < UINT16_MAX)
+  {
+    (*counter)++;
+  }
+}
+
+/* called every time a wind window closes */
+extern void wind_rose_add(uint32_t pulses, uint16_t vane_reading)
+{
+  uint8_t bin = wind_rose_speed_bin(pulses);
+#ifdef WIND_ROSE_SECTOR_LUT
+  uint8_t sector = sector_lut[vane_reading >> 4];
+#else
+  uint8_t sector = wind_rose_sector(vane_reading);
+#endif
+
+  critical_section_enter_blocking(&rose_crit_sec);
+  inc_saturated(&hour_rose[sector][bin]);
+  inc_saturated(&day_rose[sector][bin]);
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern void wind_rose_hour_reset()
+{
+  critical_section_enter_blocking(&rose_crit_sec);
+  memset(hour_rose, 0, sizeof(hour_rose));
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern void wind_rose_day_reset()
+{
+  critical_section_enter_blocking(&rose_crit_sec);
+  memset(day_rose, 0, sizeof(day_rose));
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern void wind_rose_read(uint8_t block[WIND_ROSE_BLOCK_SIZE])
+{
+  critical_section_enter_blocking(&rose_crit_sec);
+  memcpy(block, hour_rose, sizeof(hour_rose));
+  memcpy(block + sizeof(hour_rose), day_rose, sizeof(day_rose));
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern void wind_rose_save_state(wind_rose_state_t *state)
+{
+  critical_section_enter_blocking(&rose_crit_sec);
+  memcpy(state->hour, hour_rose, sizeof(hour_rose));
+  memcpy(state->day, day_rose, sizeof(day_rose));
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern void wind_rose_restore_state(const wind_rose_state_t *state)
+{
+  critical_section_enter_blocking(&rose_crit_sec);
+  memcpy(hour_rose, state->hour, sizeof(hour_rose));
+  memcpy(day_rose, state->day, sizeof(day_rose));
+  critical_section_exit(&rose_crit_sec);
+}
+
+extern bool wind_rose_init()
+{
+  critical_section_init(&rose_crit_sec);
+
+  for (uint32_t pulses = 0; pulses < WIND_ROSE_PULSES_LUT_SIZE; pulses++)
+  {
+    float kmh = pulses * WIND_KMH_PER_PULSE;
+    uint8_t bin = 0;
+
+    while (bin < WIND_ROSE_SPEED_BINS - 1 && kmh >= speed_bin_bounds_kmh[bin])
+    {
+      bin++;
+    }
+    speed_bin_lut[pulses] = bin;
+  }
+
+#ifdef WIND_ROSE_SECTOR_LUT
+  for (uint32_t i = 0; i < sizeof(sector_lut); i++)
+  {
+    // middle of the codes sharing this entry
+    sector_lut[i] = wind_rose_sector((i << 4) + 8);
+  }
+#endif
+
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _WIND_ROSE_H_
+#define _WIND_ROSE_H_
+
+#include <pico/stdlib.h>
+
+/*
+ * Wind rose: how many wind windows (WIND_SAMPLER_SECS each) fell in each
+ * direction sector and speed bin, for the current hour and the current day.
+ *
+ * Sector 0 is N, going clockwise 22.5 degrees each.
+ * Speed bins upper bounds, km/h: 2, 6, 12, 20, 29, 39, 50, last one open ended
+ * (roughly Beaufort 0 to 7+). Bin 0 is calm, its direction is meaningless.
+ */
+#define WIND_ROSE_SECTORS 16
+#define WIND_ROSE_SPEED_BINS 8
+
+/* Map ADC codes to sectors with a lookup table instead of computing them */
+// #define WIND_ROSE_SECTOR_LUT
+
+/*
+ * Degrees added to the vane reading, for a vane not pointing north when
+ * the ADC reads 0. Applied with or without the lookup table.
+ */
+#define WIND_VANE_OFFSET_DEG 0
+
+#if WIND_VANE_OFFSET_DEG <= -360 || WIND_VANE_OFFSET_DEG >= 360
+#error "WIND_VANE_OFFSET_DEG must be within -359 and 359"
+#endif
+
+/* hour matrix followed by day matrix, each [sector][speed bin] of uint16 */
+#define WIND_ROSE_MATRIX_SIZE (WIND_ROSE_SECTORS * WIND_ROSE_SPEED_BINS * sizeof(uint16_t))
+#define WIND_ROSE_BLOCK_SIZE (2 * WIND_ROSE_MATRIX_SIZE)
+
+/* both matrices, kept across a warm reboot */
+typedef struct
+{
+  uint16_t hour[WIND_ROSE_SECTORS][WIND_ROSE_SPEED_BINS];
+  uint16_t day[WIND_ROSE_SECTORS][WIND_ROSE_SPEED_BINS];
+} wind_rose_state_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern bool wind_rose_init();
+  extern void wind_rose_add(uint32_t pulses, uint16_t vane_reading);
+  extern void wind_rose_hour_reset();
+  extern void wind_rose_day_reset();
+  extern void wind_rose_read(uint8_t block[WIND_ROSE_BLOCK_SIZE]);
+  extern void wind_rose_save_state(wind_rose_state_t *state);
+  extern void wind_rose_restore_state(const wind_rose_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif